@@ -3,9 +3,12 @@
 #include "wave.h"
 #include "aiff.h"
 #include "wavedefs.h"
-#include "endian.h"
+#include "pcm.h"
+#include "threadpool.h"
+#include "pathlist.h"
 #include "util.h"
 #include <stdbool.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <float.h>
@@ -22,143 +25,61 @@ static AIFFMarkerPlayMode aiffPlayModeFromSmplLoopType(SamplerLoopType type)
 	}
 }
 
-int main(int argc, char** argv)
+typedef enum
 {
-	//FIXME: real CLI
-	if (argc < 1)
-		return 1;
-	const char* inName = argv[1];
-	StreamHandle in;
-	if (streamFileOpen(&in, inName, "rb"))
-		return 1;
-
-	// Read & verify header
-	IffChunk riff;
-	IffFourCC filetype;
-	streamRead(in, riff.fourcc.c, 1, 4);
-	streamReadU32le(in, &riff.size, 1);
-	streamRead(in, filetype.c,    1, 4);
-
-	if (!IFF_FOURCC_CMP(riff.fourcc, FOURCC_RIFF))
-		return 1;
-	if (riff.size < FORMAT_CHUNK_SIZE)
-		return 1;
-	if (!IFF_FOURCC_CMP(filetype, FOURCC_WAVE))
-		return 1;
-
-	FormatChunk fmt;
-	SamplerChunk smpl;
-	SampleLoopChunk loops[2];
-	size_t dataOffset = 0, dataBytes = 0;
-	bool samplerPresent = false;
-
-	size_t bytes = 4;
-	do
-	{
-		IffChunk chunk;
-		memset(&chunk, 0, sizeof(IffChunk));
-		streamRead(in, &chunk.fourcc, 1, 4);
-		streamReadU32le(in, &chunk.size, 1);
-
-		if (IFF_FOURCC_CMP(chunk.fourcc, WAVE_FOURCC_FMT))
-		{
-			if (chunk.size != FORMAT_CHUNK_SIZE)
-				return 1;
+	CONVERT_OK = 0,
+	CONVERT_ERR_READ,
+	CONVERT_ERR_FORMAT,
+	CONVERT_ERR_WRITE
 
-			streamReadU16le(in, &fmt.format, 1);
-			streamReadU16le(in, &fmt.channels, 1);
-			streamReadU32le(in, &fmt.samplerate, 1);
-			streamReadU32le(in, &fmt.byterate, 1);
-			streamReadU16le(in, &fmt.alignment, 1);
-			streamReadU16le(in, &fmt.bitdepth, 1);
+} ConvertResult;
 
-		}
-		else if (IFF_FOURCC_CMP(chunk.fourcc, WAVE_FOURCC_SMPL))
-		{
-			if (chunk.size < SMPL_CHUNK_HEAD_SIZE)
-				return 1;
-
-			streamReadU32le(in, &smpl.manufacturer, 1);
-			streamReadU32le(in, &smpl.product, 1);
-			streamReadI32le(in, &smpl.samplePeriod, 1);
-			streamReadI32le(in, &smpl.midiUnityNote, 1);
-			streamReadI32le(in, &smpl.midiPitchFrac, 1);
-			streamReadI32le(in, &smpl.smpteFormat, 1);
-			streamReadU32le(in, &smpl.smpteOffset, 1);
-			streamReadU32le(in, &smpl.sampleLoopCount, 1);
-			streamReadU32le(in, &smpl.sampleData, 1);
-
-			const size_t loopsinc = SMPL_CHUNK_HEAD_SIZE + smpl.sampleLoopCount * SAMPLER_LOOP_SIZE;
-			if (chunk.size < loopsinc)
-				return 1;
-
-			// Read loops
-			SampleLoopChunk loop;
-			for (uint32_t i = 0; i < smpl.sampleLoopCount; ++i)
-			{
-				streamReadU32le(in, &loop.id, 1);
-				streamReadU32le(in, &loop.type, 1);
-				streamReadU32le(in, &loop.loopStart, 1);
-				streamReadU32le(in, &loop.loopEnd, 1);
-				streamReadU32le(in, &loop.fraction, 1);
-				streamReadU32le(in, &loop.playCount, 1);
-				if (i < 2)
-					memcpy(&loops[i], &loop, sizeof(SampleLoopChunk));
-			}
-
-			// Some apps incorrectly set the vendor data field,
-			//  so skip processing vendor data if there is none
-			if (chunk.size != loopsinc && smpl.sampleData)
-			{
-				if (smpl.sampleData != loopsinc + chunk.size)
-					return 1;
-
-				streamSkip(in, smpl.sampleData);
-			}
-
-			samplerPresent = true;
-		}
-		else if (IFF_FOURCC_CMP(chunk.fourcc, WAVE_FOURCC_DATA))
-		{
-			if (streamTell(in, &dataOffset))
-			{
-				dataBytes = chunk.size;
-				streamSkip(in, dataBytes);
-			}
-		}
-		else
-		{
-			streamSkip(in, chunk.size);
-		}
+static const char* const convertResultStrings[] =
+{
+	[CONVERT_OK]         = "OK",
+	[CONVERT_ERR_READ]   = "couldn't open or parse WAVE file",
+	[CONVERT_ERR_FORMAT] = "unsupported sample format",
+	[CONVERT_ERR_WRITE]  = "couldn't write AIFF file"
+};
 
-		bytes += sizeof(uint32_t) * 2 + chunk.size;
-		if (chunk.size & 0x1)
-		{
-			streamSkip(in, 1);
-			++bytes;
-		}
+static int openOutput(AIFFWriter* restrict writer, const char* restrict path)
+{
+	if (strcmp(path, "-"))
+		return aiffWriterFileOpen(writer, path);
+	StreamHandle hnd;
+	int err = streamFileOpenStdout(&hnd, STREAM_BUFFER_DEFAULT_SIZE);
+	if (!err)
+		aiffWriterOpen(writer, hnd);
+	return err;
+}
 
-		if (streamEOF(in) || streamError(in))
-			break;
+static ConvertResult convertFile(const char* inName, const char* outName)
+{
+	WaveReader in;
+	if (waveReaderFileOpen(&in, inName))
+		return CONVERT_ERR_READ;
+
+	const WaveSpec* fmt = &in.spec;
+	const SamplerChunk* smpl = &in.sampler;
+	const SampleLoopChunk* loops = in.loops;
+	const bool samplerPresent = in.hasSampler;
+	if (fmt->format != WAVESPEC_FORMAT_PCM)
+	{
+		waveReaderClose(&in);
+		return CONVERT_ERR_FORMAT;
 	}
-	while (bytes < riff.size);
-
-	if (fmt.channels > INT16_MAX)
-		return 1;
-	if (fmt.bitdepth == 0 || fmt.bitdepth > 32)
-		return 1;
 
+	// Sizes are always precalculated so the writer is forward-only, letting "-" stream to stdout
 	AIFFWriter writer;
-	const char* outName = argc > 2 ? argv[2] : "out.aif";
-	if (aiffWriterFileOpen(&writer, outName))
+	if (openOutput(&writer, outName))
 	{
-		streamClose(in);
-		return 1;
+		waveReaderClose(&in);
+		return CONVERT_ERR_WRITE;
 	}
 
-	const uint32_t byteDepth = AIFF_BITDEPTH_TO_BYTES((uint32_t)fmt.bitdepth);  //TODO: Prob not correct for wave
-	const uint32_t bytesPerFrame = byteDepth * (uint32_t)fmt.channels;
-	const size_t numFrames = dataBytes / bytesPerFrame;
+	const uint32_t byteDepth = (uint32_t)fmt->bytedepth;
+	const uint32_t bytesPerFrame = byteDepth * (uint32_t)fmt->channels;
+	const size_t numFrames = (size_t)(in.dataRemaining / bytesPerFrame);
 
 	AIFFInstrument instrument;
 	int numMarkers = 0;
@@ -169,7 +90,7 @@ int main(int argc, char** argv)
 		memset(&instrument, 0, sizeof(AIFFInstrument));
 		memset(&markers, 0, sizeof(AIFFMarker));
 
-		instrument.baseNote     = MIN(smpl.midiUnityNote, 127);
+		instrument.baseNote     = MIN(smpl->midiUnityNote, 127);
 		instrument.detune       =   0;
 		instrument.lowNote      =   0;
 		instrument.highNote     = 127;
@@ -185,7 +106,7 @@ int main(int argc, char** argv)
 		//  between frames, so end points must be offset to be exclusive.
 		memset(markers, 0, sizeof(markers));
 		int loopIdx = 0, loopMarkID = numMarkers + 1;
-		if (smpl.sampleLoopCount > 1)
+		if (smpl->sampleLoopCount > 1)
 		{
 			uint32_t loopStart = loops[loopIdx].loopStart;
 			uint32_t loopEnd = MIN(loops[loopIdx].loopEnd + 1U, (uint32_t)numFrames);
@@ -195,7 +116,7 @@ int main(int argc, char** argv)
 			instrument.sustainLoop.endLoop = loopMarkID;
 			markers[numMarkers++] = (AIFFMarker){ .id = loopMarkID++, .name = "end sus", .position = loopEnd };
 		}
-		if (smpl.sampleLoopCount == 1 || (loops[loopIdx].loopEnd && loops[loopIdx].loopStart < loops[loopIdx].loopEnd))
+		if (smpl->sampleLoopCount == 1 || (loops[loopIdx].loopEnd && loops[loopIdx].loopStart < loops[loopIdx].loopEnd))
 		{
 			uint32_t loopStart = loops[loopIdx].loopStart;
 			uint32_t loopEnd = MIN(loops[loopIdx].loopEnd + 1U, (uint32_t)numFrames);
@@ -219,58 +140,32 @@ int main(int argc, char** argv)
 		chunks |= AIFF_CHUNKFLAGS_INST;
 		last = AIFF_CHUNKFLAGS_INST;
 	}
-	aiffPrecalculateFormSize(&writer, chunks, last, markers, numMarkers, byteDepth, numFrames);
+	aiffPrecalculateFormSize(&writer, chunks, last, markers, numMarkers, bytesPerFrame, numFrames);
 
-	// Write Common chunk
+	// Write Common chunk, AIFF readers size samples from the bit depth rounded up to whole bytes,
+	//  so valid bits are only kept when they still describe the container that's written
+	const int sampleSize = (in.bitdepth > 0 && (uint32_t)(in.bitdepth + 7) / 8 == byteDepth)
+		? in.bitdepth : (int)byteDepth * 8;
 	aiffWriteCommonChunk(&writer,
-		(int16_t)fmt.channels,
+		(int16_t)fmt->channels,
 		(uint32_t)numFrames,
-		(int16_t)fmt.bitdepth,
-		fmt.samplerate);
+		(int16_t)sampleSize,
+		fmt->rate);
 
-	// Write Sound Data chunk & audio data
-	streamSeek(in, dataOffset, STREAM_SEEK_SET);
+	// Write Sound Data chunk & audio data, the reader hands out samples in host byte order
 #define BLOCK_SIZE (1024 * 16)
 	uint8_t buffer[BLOCK_SIZE];
-	do
+	const size_t blockFrames = MAX(1, BLOCK_SIZE / bytesPerFrame);
+	size_t frames;
+	while ((frames = waveReaderReadFrames(&in, buffer, blockFrames)) > 0)
 	{
-		const size_t bufferSize = MIN(BLOCK_SIZE, dataBytes);
-		const size_t frames = bufferSize / byteDepth;
-		const size_t bytesRead = streamRead(in, buffer, byteDepth, frames);
+		const size_t samples = frames * fmt->channels;
+		// 8-bit samples are stored unsigned in WAVE for some reason,
+		//  so convert each sample to avoid ear sadness.
 		if (byteDepth == 1)
-		{
-			// 8-bit samples are stored unsigned in WAVE for some reason,
-			//  so convert each sample to avoid ear sadness.
-			for (size_t i = 0; i < frames; ++i)
-				buffer[i] ^= 0x80;
-		}
-		// WAVE stores >=2 byte samples in little endian, so we must
-		//  convert them to big-endian before writing them to AIFF.
-		else if (byteDepth == 2)
-		{
-			uint16_t* samples = (uint16_t*)buffer;
-			for (size_t i = 0; i < frames; ++i)
-				samples[i] = swap16(samples[i]);
-		}
-		else if (byteDepth == 3)
-		{
-			for (size_t i = 0; i < frames; ++i)
-			{
-				uint8_t tmp = buffer[i * 3];
-				buffer[i * 3 + 0] = buffer[i * 3 + 2];
-				buffer[i * 3 + 2] = tmp;
-			}
-		}
-		else if (byteDepth == 4)
-		{
-			uint32_t* samples = (uint32_t*)buffer;
-			for (size_t i = 0; i < frames; ++i)
-				samples[i] = swap32(samples[i]);
-		}
-		aiffWriteSoundFrames(&writer, buffer, byteDepth, frames);
-		dataBytes -= bufferSize;
+			pcmFlipSign8(buffer, buffer, samples);
+		aiffWriteSoundFrames(&writer, buffer, byteDepth, samples);
 	}
-	while (dataBytes > 0);
 
 	// Write Marker chunk & markers
 	if (numMarkers)
@@ -280,9 +175,170 @@ int main(int argc, char** argv)
 	if (samplerPresent)
 		aiffWriteInstrumentChunk(&writer, &instrument);
 
-	aiffWriterClose(&writer);
+	const int err = aiffWriterClose(&writer);
+
+	waveReaderClose(&in);
+
+	return err ? CONVERT_ERR_WRITE : CONVERT_OK;
+}
+
+
+typedef struct
+{
+	char* inPath;
+	char* outPath;
+	ConvertResult result;
+
+} ConvertJob;
+
+typedef struct
+{
+	ConvertJob* jobs;
+	size_t count, capacity;
+
+} JobList;
+
+static bool jobListAdd(JobList* restrict list, const char* inPath)
+{
+	if (list->count == list->capacity)
+	{
+		const size_t newCapacity = list->capacity ? list->capacity * 2 : 64;
+		ConvertJob* newJobs = realloc(list->jobs, sizeof(ConvertJob) * newCapacity);
+		if (!newJobs)
+			return false;
+		list->jobs = newJobs;
+		list->capacity = newCapacity;
+	}
+
+	// Output goes alongside the input with the extension swapped, so naming doesn't depend on scheduling
+	const size_t stemLen = pathStemLength(inPath);
+	char* in = malloc(strlen(inPath) + 1);
+	char* out = malloc(stemLen + 5);
+	if (!in || !out)
+	{
+		free(in);
+		free(out);
+		return false;
+	}
+	strcpy(in, inPath);
+	memcpy(out, inPath, stemLen);
+	memcpy(&out[stemLen], ".aif", 5);
+
+	list->jobs[list->count++] = (ConvertJob){ .inPath = in, .outPath = out, .result = CONVERT_OK };
+	return true;
+}
+
+static void convertJobRun(void* user)
+{
+	ConvertJob* job = (ConvertJob*)user;
+	job->result = convertFile(job->inPath, job->outPath);
+}
+
+static void usage(const char* argv0)
+{
+	fprintf(stderr, "Usage: %s <in.wav> <out.aif|->\n", argv0);
+	fprintf(stderr, "       %s [-r] [-j threads] <in.wav|directory>...\n", argv0);
+	fprintf(stderr, "  -r  Descend into subdirectories\n");
+	fprintf(stderr, "  -j  Number of conversion threads (default: number of CPUs)\n");
+	fprintf(stderr, "Without an output name each file is written alongside its input with an .aif extension\n");
+	exit(1);
+}
+
+int main(int argc, char** argv)
+{
+	// Parse cli arguments
+	bool batch = false, recursive = false;
+	int numThreads = 0, firstInput = 0;
+	for (int i = 1; i < argc && !firstInput; ++i)
+	{
+		if (argv[i][0] != '-' || !argv[i][1])
+			firstInput = i;
+		else if (!strcmp(argv[i], "-r"))
+			recursive = batch = true;
+		else if (!strcmp(argv[i], "-j") && i + 1 < argc)
+		{
+			numThreads = atoi(argv[++i]);
+			if (numThreads <= 0)
+				usage(argv[0]);
+			batch = true;
+		}
+		else
+			usage(argv[0]);
+	}
+	if (!firstInput)
+		usage(argv[0]);
+
+	// The second argument is only an output name if it can't be another input, so a glob
+	//  converts every match alongside itself however many there are
+	static const char* const extensions[] = { "wav", NULL };
+	if (!batch && argc - firstInput == 2 && !pathIsDirectory(argv[firstInput])
+		&& (!strcmp(argv[firstInput + 1], "-") || (!pathHasExtension(argv[firstInput + 1], extensions)
+			&& !pathIsDirectory(argv[firstInput + 1]))))
+	{
+		const char* outName = argv[firstInput + 1];
+		ConvertResult res = convertFile(argv[firstInput], outName);
+		if (res != CONVERT_OK)
+			fprintf(stderr, "%s: %s\n", argv[firstInput], convertResultStrings[res]);
+		return res == CONVERT_OK ? 0 : 1;
+	}
+
+	PathList inputs = PATHLIST_CLEAR();
+	int ret = 0;
+	for (int i = firstInput; i < argc; ++i)
+	{
+		const bool ok = pathIsDirectory(argv[i])
+			? pathListAddDirectory(&inputs, argv[i], extensions, recursive)
+			: pathListAdd(&inputs, argv[i]);
+		if (!ok)
+		{
+			fprintf(stderr, "%s: couldn't list inputs\n", argv[i]);
+			ret = 1;
+		}
+	}
 
-	streamClose(in);
+	JobList list = { .jobs = NULL, .count = 0, .capacity = 0 };
+	for (size_t i = 0; i < inputs.count; ++i)
+	{
+		if (!jobListAdd(&list, inputs.paths[i]))
+		{
+			fprintf(stderr, "Out of memory\n");
+			ret = 1;
+			break;
+		}
+	}
+	pathListFree(&inputs);
+
+	// A small queue keeps only a few jobs in flight, each worker streams through fixed size buffers
+	ThreadPool* pool = NULL;
+	if (!numThreads)
+		numThreads = threadPoolDefaultThreads();
+	if (list.count > 1 && numThreads > 1 && !threadPoolCreate(&pool, numThreads, numThreads * 2))
+	{
+		for (size_t i = 0; i < list.count; ++i)
+			threadPoolSubmit(pool, convertJobRun, &list.jobs[i]);
+		threadPoolDestroy(pool);
+	}
+	else
+	{
+		for (size_t i = 0; i < list.count; ++i)
+			convertJobRun(&list.jobs[i]);
+	}
+
+	// Report in input order regardless of completion order
+	size_t failed = 0;
+	for (size_t i = 0; i < list.count; ++i)
+	{
+		const ConvertJob* job = &list.jobs[i];
+		if (job->result != CONVERT_OK)
+		{
+			fprintf(stderr, "%s: %s\n", job->inPath, convertResultStrings[job->result]);
+			++failed;
+		}
+		free(job->inPath);
+		free(job->outPath);
+	}
+	fprintf(stderr, "Converted %zu of %zu files\n", list.count - failed, list.count);
+	free(list.jobs);
 
-	return 0;
+	return (ret || failed) ? 1 : 0;
 }
@@ -1,8 +1,25 @@
 #include "aiff.h"
+#include "pcm.h"
 #include "util.h"
 #include <string.h>
 
 
+#define AIFF_STAGING_SIZE 0x2000
+
+
+static const StreamField instrumentFields[] =
+{
+	STREAM_FIELD(U8,    AIFFInstrument, baseNote),
+	STREAM_FIELD(U8,    AIFFInstrument, detune),
+	STREAM_FIELD(U8,    AIFFInstrument, lowNote),
+	STREAM_FIELD(U8,    AIFFInstrument, highNote),
+	STREAM_FIELD(U8,    AIFFInstrument, lowVelocity),
+	STREAM_FIELD(U8,    AIFFInstrument, highVelocity),
+	STREAM_FIELD(U16BE, AIFFInstrument, gain),
+	STREAM_FIELD(U16BE, AIFFInstrument, sustainLoop),  // playMode, beginLoop, endLoop
+	STREAM_FIELD(U16BE, AIFFInstrument, releaseLoop)
+};
+
 static uint32_t calculateMarkerChunkSize(const AIFFMarker markers[], int count)
 {
 	uint32_t chunkSize = 2;
@@ -89,29 +106,27 @@ static void aiffWriterFlush(AIFFWriter* restrict writer, bool atEnd)
 
 	writer->chunks |= writer->lastChunk;
 
-	if (!writer->formSize)
-	{
-		if (writer->lastChunk != AIFF_CHUNKFLAGS_FORM)
-			writer->writtenChunksSize += IFF_CHUNK_HEAD_SIZE;
-		writer->writtenChunksSize += writer->lastChunkSize;
+	// Sizes are tallied even when precomputed so close can verify them
+	if (writer->lastChunk != AIFF_CHUNKFLAGS_FORM)
+		writer->writtenChunksSize += IFF_CHUNK_HEAD_SIZE;
+	writer->writtenChunksSize += writer->lastChunkSize;
 
-		// The Sound Data chunk size needs to be written if it's not precomputed
-		if (writer->lastChunk == AIFF_CHUNKFLAGS_SSND)
-		{
-			assert(writer->lastChunkSize <= UINT32_MAX);
-			uint32_t soundChunkSz = (uint32_t)writer->lastChunkSize;
-			streamSeek(writer->hnd, writer->soundDataOffset + 4, STREAM_SEEK_SET);
-			streamWriteU32be(writer->hnd, soundChunkSz);
-			streamSeek(writer->hnd, 0, STREAM_SEEK_END);
-			writer->soundChunkSize = soundChunkSz;
-		}
+	// The Sound Data chunk size needs to be written if it's not precomputed
+	if (!writer->formSize && writer->lastChunk == AIFF_CHUNKFLAGS_SSND)
+	{
+		assert(writer->lastChunkSize <= UINT32_MAX);
+		uint32_t soundChunkSz = (uint32_t)writer->lastChunkSize;
+		streamSeek(writer->hnd, writer->soundDataOffset + 4, STREAM_SEEK_SET);
+		streamWriteU32be(writer->hnd, soundChunkSz);
+		streamSeek(writer->hnd, 0, STREAM_SEEK_END);
+		writer->soundChunkSize = soundChunkSz;
 	}
 
 	// Handle chunk padding
 	if (slowPath(IFF_NEEDS_PAD(writer->lastChunkSize)))
 	{
 		streamPutC(writer->hnd, '\0');
-		if (!writer->formSize && !atEnd)  // Final pad is not included in FORM size
+		if (!atEnd)  // Final pad is not included in FORM size
 			++writer->writtenChunksSize;
 	}
 
@@ -124,7 +139,8 @@ void aiffWriterOpen(AIFFWriter* restrict writer, StreamHandle hnd)
 	assert(writer && hnd.cb);
 	(*writer) = (AIFFWriter)
 	{
-		.hnd = hnd,
+		.hnd  = hnd,
+		.sink = { .user = NULL, .cb = NULL },
 
 		.chunks    = 0,
 		.lastChunk = 0,
@@ -140,29 +156,64 @@ void aiffWriterOpen(AIFFWriter* restrict writer, StreamHandle hnd)
 int aiffWriterFileOpen(AIFFWriter* restrict writer, const char* restrict path)
 {
 	StreamHandle hnd;
-	int err = streamFileOpen(&hnd, path, "wb");
+	int err = streamFileOpenBuffered(&hnd, path, "wb", STREAM_BUFFER_DEFAULT_SIZE);
 	if (err)
 		return err;
 	aiffWriterOpen(writer, hnd);
 	return 0;
 }
 
-void aiffWriterClose(AIFFWriter* restrict writer)
+int aiffWriterOpenSpooled(AIFFWriter* restrict writer, StreamHandle sink)
+{
+	assert(writer && sink.cb);
+	StreamHandle spool;
+	int err = streamMemArenaOpen(&spool, STREAM_BUFFER_DEFAULT_SIZE, NULL, NULL);
+	if (err)
+		return err;
+	aiffWriterOpen(writer, spool);
+	writer->sink = sink;
+	return 0;
+}
+
+int aiffWriterClose(AIFFWriter* restrict writer)
 {
 	assert(writer);
 	aiffWriterFlush(writer, true);
 
-	// Overwrite FORM chunk size if not precomputed
+	int err = 0;
 	if (!writer->formSize)
 	{
+		// Overwrite FORM chunk size if not precomputed
 		const size_t formSize = writer->writtenChunksSize;
 		assert(formSize <= UINT32_MAX);
 		streamSeek(writer->hnd, 4, STREAM_SEEK_SET);
 		streamWriteU32be(writer->hnd, (uint32_t)formSize);
 		writer->formSize = (uint32_t)formSize;
 	}
+	else if (writer->writtenChunksSize != writer->formSize)
+	{
+		// A forward-only writer can't fix up the header after the fact
+		err = 1;
+	}
+
+	// Close can't report a failed flush of buffered output, so flush & check here
+	if (!streamFlush(writer->hnd) || streamError(writer->hnd))
+		err = 1;
+
+	// Emit the spooled file in a single write
+	if (writer->sink.cb)
+	{
+		size_t length;
+		const void* data = streamMemData(writer->hnd, &length);
+		if (!err && streamWrite(writer->sink, data, 1, length) != length)
+			err = 1;
+		if (!streamFlush(writer->sink) || streamError(writer->sink))
+			err = 1;
+		streamClose(writer->sink);
+	}
 
 	streamClose(writer->hnd);
+	return err;
 }
 
 
@@ -248,8 +299,22 @@ void aiffWriteSoundFrames(AIFFWriter* restrict writer, const uint8_t* restrict f
 		writer->lastChunkSize = AIFF_SOUNDDATAHEADER_SIZE;
 	}
 
-	// Write Sound Data audio frames
-	streamWrite(writer->hnd, frames, depth, count);
+	// Write Sound Data audio frames, swapping to big endian through a small staging buffer if needed
+	if (PCM_NATIVE_ENDIAN == PCM_BIG_ENDIAN || depth == 1)
+	{
+		streamWrite(writer->hnd, frames, depth, count);
+	}
+	else
+	{
+		uint8_t staging[AIFF_STAGING_SIZE];
+		const size_t chunk = AIFF_STAGING_SIZE / depth;
+		for (size_t i = 0; i < count; i += chunk)
+		{
+			const size_t n = MIN(chunk, count - i);
+			pcmSwap(staging, &frames[i * depth], (int)depth, n);
+			streamWrite(writer->hnd, staging, depth, n);
+		}
+	}
 
 	writer->lastChunk = AIFF_CHUNKFLAGS_SSND;
 	writer->lastChunkSize += depth * count;  // Appending to existing SSND chunk
@@ -289,19 +354,7 @@ void aiffWriteInstrumentChunk(AIFFWriter* restrict writer, const AIFFInstrument*
 	// Write Instrument chunk
 	streamWrite(writer->hnd, AIFF_FOURCC_INST.c, 1, 4);
 	streamWriteU32be(writer->hnd, AIFF_INSTRUMENT_SIZE);
-	streamWrite(writer->hnd, &instrument->baseNote, 1, 1);
-	streamWrite(writer->hnd, &instrument->detune, 1, 1);
-	streamWrite(writer->hnd, &instrument->lowNote, 1, 1);
-	streamWrite(writer->hnd, &instrument->highNote, 1, 1);
-	streamWrite(writer->hnd, &instrument->lowVelocity, 1, 1);
-	streamWrite(writer->hnd, &instrument->highVelocity, 1, 1);
-	streamWriteI16be(writer->hnd, instrument->gain);
-	streamWriteI16be(writer->hnd, instrument->sustainLoop.playMode);
-	streamWriteI16be(writer->hnd, instrument->sustainLoop.beginLoop);
-	streamWriteI16be(writer->hnd, instrument->sustainLoop.endLoop);
-	streamWriteI16be(writer->hnd, instrument->releaseLoop.playMode);
-	streamWriteI16be(writer->hnd, instrument->releaseLoop.beginLoop);
-	streamWriteI16be(writer->hnd, instrument->releaseLoop.endLoop);
+	streamWriteRecord(writer->hnd, instrument, instrumentFields, sizeof(instrumentFields) / sizeof(StreamField));
 
 	writer->lastChunk = AIFF_CHUNKFLAGS_INST;
 	writer->lastChunkSize = AIFF_INSTRUMENT_SIZE;
@@ -23,9 +23,10 @@ typedef enum AIFFChunkFlags
 typedef struct AIFFWriter
 {
 	StreamHandle hnd;
+	StreamHandle sink;  // Final output when spooling, hnd is then an in-memory arena
 	AIFFChunkFlags chunks;
 	AIFFChunkFlags lastChunk;
-	size_t soundDataOffset;
+	uint64_t soundDataOffset;
 	uint32_t markerChunkSize;
 	uint32_t soundChunkSize;
 	uint32_t formSize;
@@ -36,8 +37,13 @@ typedef struct AIFFWriter
 
 void aiffWriterOpen(AIFFWriter* restrict writer, StreamHandle hnd);
 int aiffWriterFileOpen(AIFFWriter* restrict writer, const char* restrict path);
-void aiffWriterClose(AIFFWriter* restrict writer);
+// Assemble the file in memory and emit it to sink in one forward pass on close,
+//  for non-seekable outputs when the frame count isn't known up front
+int aiffWriterOpenSpooled(AIFFWriter* restrict writer, StreamHandle sink);
+// Returns non-zero if writing failed or a precalculated size didn't match what was written
+int aiffWriterClose(AIFFWriter* restrict writer);
 
+// Once sizes are precalculated the writer never seeks or tells, so hnd may be a pipe or socket
 void aiffPrecalculateFormSize(AIFFWriter* restrict writer,
 	AIFFChunkFlags chunks, AIFFChunkFlags lastChunk,
 	const AIFFMarker markers[], uint16_t numMarkers,
@@ -47,6 +53,7 @@ void aiffWriteCommonChunk(AIFFWriter* writer,
 	uint32_t frames,
 	int16_t  bitDepth,
 	uint32_t rate);
+// Samples are taken in host byte order and written big endian, 8-bit samples are signed
 void aiffWriteSoundFrames(AIFFWriter* restrict writer, const uint8_t* restrict data, size_t depth, size_t count);
 void aiffWriteMarkers(AIFFWriter* restrict writer, const AIFFMarker markers[], uint16_t num);
 void aiffWriteInstrumentChunk(AIFFWriter* restrict writer, const AIFFInstrument* restrict instrument);
@@ -0,0 +1,108 @@
+/* interleave.c (c) 2025 a dinosaur (zlib) */
+
+#include "interleave.h"
+#include "util.h"
+#include "simd.h"
+#include <stdint.h>
+#include <string.h>
+
+
+static FORCE_INLINE void interleaveScalar(uint8_t* restrict dst, const void* const planes[], int channels,
+	size_t width, size_t offset, size_t count)
+{
+	// Called with constant widths so each memcpy collapses to a single load/store
+	for (size_t i = 0; i < count; ++i)
+		for (int j = 0; j < channels; ++j, dst += width)
+			memcpy(dst, &((const uint8_t*)planes[j])[(offset + i) * width], width);
+}
+
+// Vector loops zip 16 (or 32 with AVX2) bytes of each channel per iteration, scalar handles the tail.
+// Nothing in the build passes -mavx2, so x86-64 builds get the SSE2 kernels unless CMAKE_C_FLAGS adds it.
+#define INTERLEAVE_STEREO_KERNEL(NAME, WIDTH, EPI, T, VT, SUFFIX) \
+static void NAME(uint8_t* restrict dst, const uint8_t* restrict l, const uint8_t* restrict r, size_t count) \
+{ \
+	size_t i = 0; \
+	AVX2_STEREO(WIDTH, EPI) \
+	SSE2_STEREO(WIDTH, EPI) \
+	NEON_STEREO(WIDTH, T, VT, SUFFIX) \
+	for (; i < count; ++i) \
+	{ \
+		memcpy(&dst[i * 2 * WIDTH], &l[i * WIDTH], WIDTH); \
+		memcpy(&dst[i * 2 * WIDTH + WIDTH], &r[i * WIDTH], WIDTH); \
+	} \
+}
+
+#if USE_AVX2
+# define AVX2_STEREO(WIDTH, EPI) \
+	for (; i + 32 / WIDTH <= count; i += 32 / WIDTH) \
+	{ \
+		const __m256i a = _mm256_loadu_si256((const __m256i*)&l[i * WIDTH]); \
+		const __m256i b = _mm256_loadu_si256((const __m256i*)&r[i * WIDTH]); \
+		const __m256i lo = _mm256_unpacklo_##EPI(a, b), hi = _mm256_unpackhi_##EPI(a, b); \
+		_mm256_storeu_si256((__m256i*)&dst[i * 2 * WIDTH],      _mm256_permute2x128_si256(lo, hi, 0x20)); \
+		_mm256_storeu_si256((__m256i*)&dst[i * 2 * WIDTH + 32], _mm256_permute2x128_si256(lo, hi, 0x31)); \
+	}
+#else
+# define AVX2_STEREO(WIDTH, EPI)
+#endif
+
+#if USE_SSE2
+# define SSE2_STEREO(WIDTH, EPI) \
+	for (; i + 16 / WIDTH <= count; i += 16 / WIDTH) \
+	{ \
+		const __m128i a = _mm_loadu_si128((const __m128i*)&l[i * WIDTH]); \
+		const __m128i b = _mm_loadu_si128((const __m128i*)&r[i * WIDTH]); \
+		_mm_storeu_si128((__m128i*)&dst[i * 2 * WIDTH],      _mm_unpacklo_##EPI(a, b)); \
+		_mm_storeu_si128((__m128i*)&dst[i * 2 * WIDTH + 16], _mm_unpackhi_##EPI(a, b)); \
+	}
+#else
+# define SSE2_STEREO(WIDTH, EPI)
+#endif
+
+#if USE_NEON
+# define NEON_STEREO(WIDTH, T, VT, SUFFIX) \
+	for (; i + 16 / WIDTH <= count; i += 16 / WIDTH) \
+	{ \
+		VT pair; \
+		pair.val[0] = vld1q_##SUFFIX((const T*)&l[i * WIDTH]); \
+		pair.val[1] = vld1q_##SUFFIX((const T*)&r[i * WIDTH]); \
+		vst2q_##SUFFIX((T*)&dst[i * 2 * WIDTH], pair); \
+	}
+#else
+# define NEON_STEREO(WIDTH, T, VT, SUFFIX)
+#endif
+
+INTERLEAVE_STEREO_KERNEL(interleaveStereo8,  1, epi8,  uint8_t,  uint8x16x2_t, u8)
+INTERLEAVE_STEREO_KERNEL(interleaveStereo16, 2, epi16, uint16_t, uint16x8x2_t, u16)
+INTERLEAVE_STEREO_KERNEL(interleaveStereo32, 4, epi32, uint32_t, uint32x4x2_t, u32)
+
+void interleave(void* restrict dst, const void* const planes[], int channels, int bytedepth,
+	size_t offset, size_t count)
+{
+	if (channels == 1)
+	{
+		memcpy(dst, &((const uint8_t*)planes[0])[offset * bytedepth], count * bytedepth);
+		return;
+	}
+
+	if (channels == 2 && bytedepth != 3)
+	{
+		const uint8_t* l = &((const uint8_t*)planes[0])[offset * bytedepth];
+		const uint8_t* r = &((const uint8_t*)planes[1])[offset * bytedepth];
+		switch (bytedepth)
+		{
+		case 1: interleaveStereo8((uint8_t*)dst, l, r, count); return;
+		case 2: interleaveStereo16((uint8_t*)dst, l, r, count); return;
+		case 4: interleaveStereo32((uint8_t*)dst, l, r, count); return;
+		}
+	}
+
+	switch (bytedepth)
+	{
+	case 1:  interleaveScalar((uint8_t*)dst, planes, channels, 1, offset, count); break;
+	case 2:  interleaveScalar((uint8_t*)dst, planes, channels, 2, offset, count); break;
+	case 3:  interleaveScalar((uint8_t*)dst, planes, channels, 3, offset, count); break;
+	case 4:  interleaveScalar((uint8_t*)dst, planes, channels, 4, offset, count); break;
+	default: interleaveScalar((uint8_t*)dst, planes, channels, (size_t)bytedepth, offset, count); break;
+	}
+}
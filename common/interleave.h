@@ -0,0 +1,11 @@
+#ifndef INTERLEAVE_H
+#define INTERLEAVE_H
+
+#include <stddef.h>
+
+// Interleave count frames of bytedepth sized samples starting from frame offset in each of
+//  the planar channel buffers into dst, which must hold count * channels * bytedepth bytes
+void interleave(void* restrict dst, const void* const planes[], int channels, int bytedepth,
+	size_t offset, size_t count);
+
+#endif//INTERLEAVE_H
@@ -0,0 +1,134 @@
+/* nibble.c (c) 2025 a dinosaur (zlib) */
+
+#include "nibble.h"
+#include "util.h"
+#include "simd.h"
+#include <stdbool.h>
+
+
+// Signed nibbles are sign extended with (n ^ 8) - 8, vector loops expand 16 (or 32 with AVX2)
+//  bytes per iteration & the scalar loop handles the tail
+static FORCE_INLINE void nibbleUnpackKernel(uint8_t* restrict dst, const uint8_t* restrict src, size_t bytes,
+	bool sign)
+{
+	size_t i = 0;
+#if USE_AVX2
+	{
+		const __m256i mask = _mm256_set1_epi8(0x0F), bias = _mm256_set1_epi8(0x08);
+		for (; i + 32 <= bytes; i += 32)
+		{
+			const __m256i v = _mm256_loadu_si256((const __m256i*)&src[i]);
+			__m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), mask), lo = _mm256_and_si256(v, mask);
+			if (sign)
+			{
+				hi = _mm256_sub_epi8(_mm256_xor_si256(hi, bias), bias);
+				lo = _mm256_sub_epi8(_mm256_xor_si256(lo, bias), bias);
+			}
+			const __m256i a = _mm256_unpacklo_epi8(hi, lo), b = _mm256_unpackhi_epi8(hi, lo);
+			_mm256_storeu_si256((__m256i*)&dst[i * 2],      _mm256_permute2x128_si256(a, b, 0x20));
+			_mm256_storeu_si256((__m256i*)&dst[i * 2 + 32], _mm256_permute2x128_si256(a, b, 0x31));
+		}
+	}
+#endif
+#if USE_SSE2
+	{
+		const __m128i mask = _mm_set1_epi8(0x0F), bias = _mm_set1_epi8(0x08);
+		for (; i + 16 <= bytes; i += 16)
+		{
+			const __m128i v = _mm_loadu_si128((const __m128i*)&src[i]);
+			__m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), mask), lo = _mm_and_si128(v, mask);
+			if (sign)
+			{
+				hi = _mm_sub_epi8(_mm_xor_si128(hi, bias), bias);
+				lo = _mm_sub_epi8(_mm_xor_si128(lo, bias), bias);
+			}
+			_mm_storeu_si128((__m128i*)&dst[i * 2],      _mm_unpacklo_epi8(hi, lo));
+			_mm_storeu_si128((__m128i*)&dst[i * 2 + 16], _mm_unpackhi_epi8(hi, lo));
+		}
+	}
+#elif USE_NEON
+	{
+		const uint8x16_t mask = vdupq_n_u8(0x0F), bias = vdupq_n_u8(0x08);
+		for (; i + 16 <= bytes; i += 16)
+		{
+			const uint8x16_t v = vld1q_u8(&src[i]);
+			uint8x16x2_t pair;
+			pair.val[0] = vshrq_n_u8(v, 4);
+			pair.val[1] = vandq_u8(v, mask);
+			if (sign)
+			{
+				pair.val[0] = vsubq_u8(veorq_u8(pair.val[0], bias), bias);
+				pair.val[1] = vsubq_u8(veorq_u8(pair.val[1], bias), bias);
+			}
+			vst2q_u8(&dst[i * 2], pair);
+		}
+	}
+#endif
+	for (; i < bytes; ++i)
+	{
+		const unsigned hi = src[i] >> 4, lo = src[i] & 0x0F;
+		dst[i * 2]     = (uint8_t)(sign ? (hi ^ 0x8) - 0x8 : hi);
+		dst[i * 2 + 1] = (uint8_t)(sign ? (lo ^ 0x8) - 0x8 : lo);
+	}
+}
+
+void nibbleUnpack(uint8_t* restrict dst, const void* restrict src, size_t bytes)
+{
+	nibbleUnpackKernel(dst, (const uint8_t*)src, bytes, false);
+}
+
+void nibbleUnpackSigned(int8_t* restrict dst, const void* restrict src, size_t bytes)
+{
+	nibbleUnpackKernel((uint8_t*)dst, (const uint8_t*)src, bytes, true);
+}
+
+void nibblePack(uint8_t* restrict dst, const void* restrict nibbles, size_t count)
+{
+	const uint8_t* restrict src = (const uint8_t*)nibbles;
+	const size_t bytes = count / 2;
+	size_t i = 0;
+#if USE_AVX2
+	{
+		// Each 16-bit lane holds a pair, first nibble in the low byte
+		const __m256i hiMask = _mm256_set1_epi16(0x00F0), loMask = _mm256_set1_epi16(0x000F);
+		for (; i + 32 <= bytes; i += 32)
+		{
+			const __m256i a = _mm256_loadu_si256((const __m256i*)&src[i * 2]);
+			const __m256i b = _mm256_loadu_si256((const __m256i*)&src[i * 2 + 32]);
+			const __m256i pa = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(a, 4), hiMask),
+				_mm256_and_si256(_mm256_srli_epi16(a, 8), loMask));
+			const __m256i pb = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(b, 4), hiMask),
+				_mm256_and_si256(_mm256_srli_epi16(b, 8), loMask));
+			_mm256_storeu_si256((__m256i*)&dst[i], _mm256_permute4x64_epi64(_mm256_packus_epi16(pa, pb), 0xD8));
+		}
+	}
+#endif
+#if USE_SSE2
+	{
+		const __m128i hiMask = _mm_set1_epi16(0x00F0), loMask = _mm_set1_epi16(0x000F);
+		for (; i + 16 <= bytes; i += 16)
+		{
+			const __m128i a = _mm_loadu_si128((const __m128i*)&src[i * 2]);
+			const __m128i b = _mm_loadu_si128((const __m128i*)&src[i * 2 + 16]);
+			const __m128i pa = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(a, 4), hiMask),
+				_mm_and_si128(_mm_srli_epi16(a, 8), loMask));
+			const __m128i pb = _mm_or_si128(_mm_and_si128(_mm_slli_epi16(b, 4), hiMask),
+				_mm_and_si128(_mm_srli_epi16(b, 8), loMask));
+			_mm_storeu_si128((__m128i*)&dst[i], _mm_packus_epi16(pa, pb));
+		}
+	}
+#elif USE_NEON
+	{
+		const uint8x16_t mask = vdupq_n_u8(0x0F);
+		for (; i + 16 <= bytes; i += 16)
+		{
+			const uint8x16x2_t pair = vld2q_u8(&src[i * 2]);
+			vst1q_u8(&dst[i], vorrq_u8(vshlq_n_u8(pair.val[0], 4), vandq_u8(pair.val[1], mask)));
+		}
+	}
+#endif
+	for (; i < bytes; ++i)
+		dst[i] = (uint8_t)(src[i * 2] << 4 | (src[i * 2 + 1] & 0x0F));
+	if (count & 1)
+		dst[bytes] = (uint8_t)(src[count - 1] << 4);
+}
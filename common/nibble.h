@@ -0,0 +1,17 @@
+#ifndef NIBBLE_H
+#define NIBBLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Nibble streams are packed two to a byte with the high nibble first, as used by every ADPCM format here
+
+// Expand bytes of packed nibbles into 2 * bytes values in [0, 15]
+void nibbleUnpack(uint8_t* restrict dst, const void* restrict src, size_t bytes);
+// Expand bytes of packed nibbles into 2 * bytes two's complement values in [-8, 7]
+void nibbleUnpackSigned(int8_t* restrict dst, const void* restrict src, size_t bytes);
+// Pack count nibbles into (count + 1) / 2 bytes, only the low 4 bits of each value are used
+//  & an odd trailing nibble gets a zero low nibble
+void nibblePack(uint8_t* restrict dst, const void* restrict nibbles, size_t count);
+
+#endif//NIBBLE_H
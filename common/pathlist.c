@@ -0,0 +1,221 @@
+/* pathlist.c (c) 2025 a dinosaur (zlib) */
+
+#include "pathlist.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+# include <direct.h>
+#else
+# include <sys/stat.h>
+# include <dirent.h>
+#endif
+
+
+static inline bool isSeparator(char c)
+{
+	return c == '/' || c == '\\';
+}
+
+bool pathIsDirectory(const char* path)
+{
+#ifdef _WIN32
+	const DWORD attribs = GetFileAttributesA(path);
+	return attribs != INVALID_FILE_ATTRIBUTES && (attribs & FILE_ATTRIBUTE_DIRECTORY);
+#else
+	struct stat st;
+	return !stat(path, &st) && S_ISDIR(st.st_mode);
+#endif
+}
+
+// Symbolic links & junctions, which recursion doesn't follow as they can form loops
+static bool isLink(const char* path)
+{
+#ifdef _WIN32
+	const DWORD attribs = GetFileAttributesA(path);
+	return attribs != INVALID_FILE_ATTRIBUTES && (attribs & FILE_ATTRIBUTE_REPARSE_POINT);
+#else
+	struct stat st;
+	return !lstat(path, &st) && S_ISLNK(st.st_mode);
+#endif
+}
+
+char* pathJoin(const char* restrict dir, const char* restrict name)
+{
+	const size_t dirLen = strlen(dir), nameLen = strlen(name);
+	const bool sep = dirLen && !isSeparator(dir[dirLen - 1]);
+	char* path = malloc(dirLen + sep + nameLen + 1);
+	if (!path)
+		return NULL;
+	memcpy(path, dir, dirLen);
+	if (sep)
+		path[dirLen] = '/';
+	memcpy(&path[dirLen + sep], name, nameLen + 1);
+	return path;
+}
+
+static int makeDirectory(const char* path)
+{
+#ifdef _WIN32
+	const int res = _mkdir(path);
+#else
+	const int res = mkdir(path, 0777);
+#endif
+	if (!res || (errno == EEXIST && pathIsDirectory(path)))
+	{
+		errno = 0;
+		return 0;
+	}
+	const int err = errno;
+	errno = 0;
+	return err;
+}
+
+int pathMakeDirectories(const char* path)
+{
+	const size_t len = strlen(path);
+	char* partial = malloc(len + 1);
+	if (!partial)
+		return ENOMEM;
+	memcpy(partial, path, len + 1);
+
+	// Create each ancestor in turn, skipping the root
+	int err = 0;
+	for (size_t i = 1; i < len && !err; ++i)
+	{
+		if (!isSeparator(partial[i]) || isSeparator(partial[i - 1]) || partial[i - 1] == ':')
+			continue;
+		partial[i] = '\0';
+		err = makeDirectory(partial);
+		partial[i] = path[i];
+	}
+	if (!err)
+		err = makeDirectory(partial);
+	free(partial);
+	return err;
+}
+
+
+bool pathListAdd(PathList* restrict list, const char* restrict path)
+{
+	if (list->count == list->capacity)
+	{
+		const size_t newCapacity = list->capacity ? list->capacity * 2 : 64;
+		char** newPaths = realloc(list->paths, sizeof(char*) * newCapacity);
+		if (!newPaths)
+			return false;
+		list->paths = newPaths;
+		list->capacity = newCapacity;
+	}
+	const size_t size = strlen(path) + 1;
+	if (!(list->paths[list->count] = malloc(size)))
+		return false;
+	memcpy(list->paths[list->count++], path, size);
+	return true;
+}
+
+size_t pathStemLength(const char* path)
+{
+	const char* ext = strrchr(path, '.');
+	return (ext && !strpbrk(ext, "/\\")) ? (size_t)(ext - path) : strlen(path);
+}
+
+bool pathHasExtension(const char* path, const char* const extensions[])
+{
+	const char* ext = strrchr(path, '.');
+	if (!ext || strpbrk(ext, "/\\"))
+		return false;
+	++ext;
+	for (; *extensions; ++extensions)
+	{
+		const char* a = ext, * b = *extensions;
+		for (; *a && *b && tolower((unsigned char)*a) == tolower((unsigned char)*b); ++a, ++b);
+		if (!*a && !*b)
+			return true;
+	}
+	return false;
+}
+
+static int compareNames(const void* lhs, const void* rhs)
+{
+	return strcmp(*(char* const*)lhs, *(char* const*)rhs);
+}
+
+bool pathListAddDirectory(PathList* restrict list, const char* restrict dirPath,
+	const char* const extensions[], bool recursive)
+{
+	PathList names = PATHLIST_CLEAR();
+	bool ok = true;
+
+#ifdef _WIN32
+	char* pattern = pathJoin(dirPath, "*");
+	WIN32_FIND_DATAA find;
+	HANDLE hFind = pattern ? FindFirstFileA(pattern, &find) : INVALID_HANDLE_VALUE;
+	free(pattern);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return false;
+	do
+	{
+		const char* name = find.cFileName;
+#else
+	DIR* dir = opendir(dirPath);
+	if (!dir)
+		return false;
+	const struct dirent* entry;
+	while ((entry = readdir(dir)))
+	{
+		const char* name = entry->d_name;
+#endif
+		if (!strcmp(name, ".") || !strcmp(name, ".."))
+			continue;
+		if (!pathListAdd(&names, name))
+		{
+			ok = false;
+			break;
+		}
+#ifdef _WIN32
+	}
+	while (FindNextFileA(hFind, &find));
+	FindClose(hFind);
+#else
+	}
+	closedir(dir);
+#endif
+
+	// Directory order is filesystem dependent, sort for reproducible results
+	qsort(names.paths, names.count, sizeof(char*), compareNames);
+	for (size_t i = 0; ok && i < names.count; ++i)
+	{
+		char* path = pathJoin(dirPath, names.paths[i]);
+		if (!path)
+		{
+			ok = false;
+			break;
+		}
+		if (pathIsDirectory(path))
+		{
+			if (recursive && !isLink(path))
+				ok = pathListAddDirectory(list, path, extensions, recursive);
+		}
+		else if (pathHasExtension(path, extensions))
+		{
+			ok = pathListAdd(list, path);
+		}
+		free(path);
+	}
+
+	pathListFree(&names);
+	return ok;
+}
+
+void pathListFree(PathList* list)
+{
+	for (size_t i = 0; i < list->count; ++i)
+		free(list->paths[i]);
+	free(list->paths);
+	list->paths = NULL;
+	list->count = list->capacity = 0;
+}
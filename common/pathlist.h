@@ -0,0 +1,37 @@
+#ifndef PATHLIST_H
+#define PATHLIST_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct PathList
+{
+	char** paths;
+	size_t count, capacity;
+
+} PathList;
+
+#define PATHLIST_CLEAR() { NULL, 0, 0 }
+
+bool pathIsDirectory(const char* path);
+// Join dir & name with a separator, returns a malloc'd string or NULL
+char* pathJoin(const char* restrict dir, const char* restrict name);
+// Create a directory and any missing parents, returns 0 or an errno value
+int pathMakeDirectories(const char* path);
+// Length of path without its extension, a dot before the last separator (/ or \) doesn't count
+size_t pathStemLength(const char* path);
+// True if the extension of path case-insensitively matches one of the NULL terminated
+//  extensions (without dot)
+bool pathHasExtension(const char* path, const char* const extensions[]);
+
+// Append a copy of path, returns false if out of memory
+bool pathListAdd(PathList* restrict list, const char* restrict path);
+// Append files in dir whose extension case-insensitively matches one of the NULL terminated
+//  extensions (without dot), sorted by name within each directory so the order is reproducible.
+// Subdirectories are descended into if recursive, except symlinked ones so link loops can't recurse forever.
+// Returns false if a directory couldn't be read.
+bool pathListAddDirectory(PathList* restrict list, const char* restrict dir,
+	const char* const extensions[], bool recursive);
+void pathListFree(PathList* list);
+
+#endif//PATHLIST_H
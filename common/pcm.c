@@ -0,0 +1,164 @@
+/* pcm.c (c) 2025 a dinosaur (zlib) */
+
+#include "pcm.h"
+#include "util.h"
+#include "simd.h"
+#include <stdbool.h>
+#include <assert.h>
+
+
+extern inline void pcmConvert(void* dst, const void* src, int bytedepth, size_t count,
+	PcmByteOrder from, PcmByteOrder to);
+
+
+// Each kernel loads a whole vector before storing it, which keeps exact in-place conversion safe
+
+static void pcmSwap16(uint8_t* dst, const uint8_t* src, size_t count)
+{
+	size_t i = 0;
+#if USE_SSSE3
+	const __m128i mask = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	for (; i + 8 <= count; i += 8)
+		_mm_storeu_si128((__m128i*)&dst[i * 2], _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i * 2]), mask));
+#elif USE_SSE2
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m128i v = _mm_loadu_si128((const __m128i*)&src[i * 2]);
+		_mm_storeu_si128((__m128i*)&dst[i * 2], _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+	}
+#elif USE_NEON
+	for (; i + 8 <= count; i += 8)
+		vst1q_u8(&dst[i * 2], vrev16q_u8(vld1q_u8(&src[i * 2])));
+#endif
+	for (; i < count; ++i)
+	{
+		uint16_t v;
+		memcpy(&v, &src[i * 2], 2);
+		v = swap16(v);
+		memcpy(&dst[i * 2], &v, 2);
+	}
+}
+
+static void pcmSwap24(uint8_t* dst, const uint8_t* src, size_t count)
+{
+	size_t i = 0;
+#if USE_SSSE3
+	// Swap 5 samples per 16 byte load, the 16th byte is written back unchanged & redone next iteration
+	const __m128i mask = _mm_setr_epi8(2, 1, 0, 5, 4, 3, 8, 7, 6, 11, 10, 9, 14, 13, 12, 15);
+	for (; i + 6 <= count; i += 5)
+		_mm_storeu_si128((__m128i*)&dst[i * 3], _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i * 3]), mask));
+#elif USE_NEON
+	for (; i + 16 <= count; i += 16)
+	{
+		uint8x16x3_t v = vld3q_u8(&src[i * 3]);
+		const uint8x16_t tmp = v.val[0];
+		v.val[0] = v.val[2];
+		v.val[2] = tmp;
+		vst3q_u8(&dst[i * 3], v);
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		const uint8_t tmp = src[i * 3];
+		dst[i * 3 + 1] = src[i * 3 + 1];
+		dst[i * 3 + 0] = src[i * 3 + 2];
+		dst[i * 3 + 2] = tmp;
+	}
+}
+
+static void pcmSwap32(uint8_t* dst, const uint8_t* src, size_t count)
+{
+	size_t i = 0;
+#if USE_SSSE3
+	const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i*)&dst[i * 4], _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i * 4]), mask));
+#elif USE_SSE2
+	for (; i + 4 <= count; i += 4)
+	{
+		// Swap bytes within each word, then swap the words
+		__m128i v = _mm_loadu_si128((const __m128i*)&src[i * 4]);
+		v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+		v = _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1);
+		_mm_storeu_si128((__m128i*)&dst[i * 4], v);
+	}
+#elif USE_NEON
+	for (; i + 4 <= count; i += 4)
+		vst1q_u8(&dst[i * 4], vrev32q_u8(vld1q_u8(&src[i * 4])));
+#endif
+	for (; i < count; ++i)
+	{
+		uint32_t v;
+		memcpy(&v, &src[i * 4], 4);
+		v = swap32(v);
+		memcpy(&dst[i * 4], &v, 4);
+	}
+}
+
+void pcmSwap(void* dst, const void* src, int bytedepth, size_t count)
+{
+	assert(dst && src);
+	switch (bytedepth)
+	{
+	case 2: pcmSwap16((uint8_t*)dst, (const uint8_t*)src, count); break;
+	case 3: pcmSwap24((uint8_t*)dst, (const uint8_t*)src, count); break;
+	case 4: pcmSwap32((uint8_t*)dst, (const uint8_t*)src, count); break;
+	default:
+		if (dst != src)
+			memcpy(dst, src, count * bytedepth);
+		break;
+	}
+}
+
+void pcmFlipSign8(void* dst, const void* src, size_t count)
+{
+	assert(dst && src);
+	uint8_t* out = (uint8_t*)dst;
+	const uint8_t* in = (const uint8_t*)src;
+	size_t i = 0;
+#if USE_SSE2
+	const __m128i bias = _mm_set1_epi8((char)0x80);
+	for (; i + 16 <= count; i += 16)
+		_mm_storeu_si128((__m128i*)&out[i], _mm_xor_si128(_mm_loadu_si128((const __m128i*)&in[i]), bias));
+#elif USE_NEON
+	const uint8x16_t bias = vdupq_n_u8(0x80);
+	for (; i + 16 <= count; i += 16)
+		vst1q_u8(&out[i], veorq_u8(vld1q_u8(&in[i]), bias));
+#endif
+	for (; i < count; ++i)
+		out[i] = in[i] ^ 0x80;
+}
+
+void pcmPack24(void* restrict dst, const int32_t* restrict src, size_t count, PcmByteOrder order)
+{
+	assert(dst && src);
+	uint8_t* out = (uint8_t*)dst;
+	const bool bigEndian = order == PCM_BIG_ENDIAN;
+	size_t i = 0;
+#if USE_SSSE3 && BYTE_ORDER == LITTLE_ENDIAN
+	// Drop the top byte of 4 samples per shuffle, stores spill 4 bytes that the next iteration overwrites
+	const __m128i mask = bigEndian
+		? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+		: _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+	for (; i + 6 <= count; i += 4)
+		_mm_storeu_si128((__m128i*)&out[i * 3], _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)&src[i]), mask));
+#elif USE_NEON && BYTE_ORDER == LITTLE_ENDIAN
+	for (; i + 16 <= count; i += 16)
+	{
+		const uint8x16x4_t v = vld4q_u8((const uint8_t*)&src[i]);
+		uint8x16x3_t packed;
+		packed.val[0] = bigEndian ? v.val[2] : v.val[0];
+		packed.val[1] = v.val[1];
+		packed.val[2] = bigEndian ? v.val[0] : v.val[2];
+		vst3q_u8(&out[i * 3], packed);
+	}
+#endif
+	for (; i < count; ++i)
+	{
+		const uint32_t v = (uint32_t)src[i];
+		const uint8_t lo = (uint8_t)v, mid = (uint8_t)(v >> 8), hi = (uint8_t)(v >> 16);
+		out[i * 3 + 0] = bigEndian ? hi : lo;
+		out[i * 3 + 1] = mid;
+		out[i * 3 + 2] = bigEndian ? lo : hi;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef PCM_H
+#define PCM_H
+
+#include "endian.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef enum PcmByteOrder
+{
+	PCM_LITTLE_ENDIAN,
+	PCM_BIG_ENDIAN
+
+} PcmByteOrder;
+
+#if BYTE_ORDER == LITTLE_ENDIAN
+# define PCM_NATIVE_ENDIAN PCM_LITTLE_ENDIAN
+#else
+# define PCM_NATIVE_ENDIAN PCM_BIG_ENDIAN
+#endif
+
+// The sample kernels below accept dst == src for in-place conversion, otherwise they must not overlap
+
+// Reverse the byte order of count packed samples that are 2, 3, or 4 bytes wide
+void pcmSwap(void* dst, const void* src, int bytedepth, size_t count);
+// Toggle 8-bit samples between unsigned (WAVE) and two's complement (AIFF) representations
+void pcmFlipSign8(void* dst, const void* src, size_t count);
+// Pack the low 24 bits of each native 32-bit sample into 3 bytes of the requested byte order
+void pcmPack24(void* restrict dst, const int32_t* restrict src, size_t count, PcmByteOrder order);
+
+// Convert count samples between byte orders, copying when no swap is necessary
+inline void pcmConvert(void* dst, const void* src, int bytedepth, size_t count, PcmByteOrder from, PcmByteOrder to)
+{
+	if (from != to && bytedepth > 1)
+		pcmSwap(dst, src, bytedepth, count);
+	else if (dst != src)
+		memcpy(dst, src, count * bytedepth);
+}
+
+#endif//PCM_H
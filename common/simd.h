@@ -0,0 +1,22 @@
+#ifndef COMMON_SIMD_H
+#define COMMON_SIMD_H
+
+// Compile-time selection of vector instruction sets, kernels fall back to scalar loops otherwise
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+# include <emmintrin.h>
+# define USE_SSE2 1
+#endif
+#if defined(__SSSE3__) || defined(__AVX__)
+# include <tmmintrin.h>
+# define USE_SSSE3 1
+#endif
+#if defined(__AVX2__)
+# include <immintrin.h>
+# define USE_AVX2 1
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+# include <arm_neon.h>
+# define USE_NEON 1
+#endif
+
+#endif//COMMON_SIMD_H
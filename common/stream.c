@@ -5,14 +5,17 @@ extern inline size_t streamRead(StreamHandle hnd, void *restrict out, size_t siz
 extern inline size_t streamWrite(StreamHandle hnd, const void *restrict in, size_t size, size_t count);
 extern inline int streamGetC(StreamHandle hnd);
 extern inline int streamPutC(StreamHandle hnd, int c);
-extern inline bool streamSkip(StreamHandle hnd, long offset);
-extern inline bool streamSeek(StreamHandle hnd, long offset, StreamWhence whence);
-extern inline bool streamTell(StreamHandle hnd, size_t* restrict result);
+extern inline bool streamSkip(StreamHandle hnd, int64_t offset);
+extern inline bool streamSeek(StreamHandle hnd, int64_t offset, StreamWhence whence);
+extern inline bool streamTell(StreamHandle hnd, uint64_t* restrict result);
 extern inline bool streamEOF(StreamHandle hnd);
 extern inline bool streamError(StreamHandle hnd);
+extern inline bool streamFlush(StreamHandle hnd);
 extern inline void streamClose(StreamHandle hnd);
+extern inline size_t streamBorrow(StreamHandle hnd, const void** restrict outData, size_t size);
 
 extern inline size_t streamReadU32le(StreamHandle hnd, uint32_t* restrict out, size_t count);
+extern inline size_t streamReadU64le(StreamHandle hnd, uint64_t* restrict out, size_t count);
 extern inline size_t streamReadU32be(StreamHandle hnd, uint32_t* restrict out, size_t count);
 extern inline size_t streamReadI32le(StreamHandle hnd, int32_t* restrict out, size_t count);
 extern inline size_t streamReadU16le(StreamHandle hnd, uint16_t* restrict out, size_t count);
@@ -20,8 +23,92 @@ extern inline size_t streamReadU16be(StreamHandle hnd, uint16_t* restrict out, s
 extern inline size_t streamReadI16be(StreamHandle hnd, int16_t* restrict out, size_t count);
 
 extern inline size_t streamWriteU32le(StreamHandle hnd, uint32_t v);
+extern inline size_t streamWriteU64le(StreamHandle hnd, uint64_t v);
 extern inline size_t streamWriteU32be(StreamHandle hnd, uint32_t v);
 extern inline size_t streamWriteI32be(StreamHandle hnd, int32_t v);
 extern inline size_t streamWriteU16le(StreamHandle hnd, uint16_t v);
 extern inline size_t streamWriteU16be(StreamHandle hnd, uint16_t v);
 extern inline size_t streamWriteI16be(StreamHandle hnd, int16_t v);
+
+extern inline StreamBuffer* streamBufferFromHandle(StreamHandle hnd);
+extern inline size_t streamBufferRead(StreamBuffer* restrict buf, void* restrict out, size_t size, size_t count);
+extern inline size_t streamBufferWrite(StreamBuffer* restrict buf, const void* restrict in, size_t size, size_t count);
+extern inline int streamBufferGetC(StreamBuffer* restrict buf);
+extern inline int streamBufferPutC(StreamBuffer* restrict buf, int c);
+
+
+static FORCE_INLINE void streamFieldConvert(uint8_t* restrict dst, const uint8_t* restrict src, StreamFieldType type)
+{
+	// Swapping is symmetric, so the same conversion packs and unpacks
+	switch (type)
+	{
+	case STREAM_FIELD_U8:
+		*dst = *src;
+		break;
+	case STREAM_FIELD_U16LE:
+	case STREAM_FIELD_U16BE:
+	{
+		uint16_t v;
+		memcpy(&v, src, 2);
+		v = (type == STREAM_FIELD_U16LE) ? SWAP_LE16(v) : SWAP_BE16(v);
+		memcpy(dst, &v, 2);
+		break;
+	}
+	case STREAM_FIELD_U32LE:
+	case STREAM_FIELD_U32BE:
+	{
+		uint32_t v;
+		memcpy(&v, src, 4);
+		v = (type == STREAM_FIELD_U32LE) ? SWAP_LE32(v) : SWAP_BE32(v);
+		memcpy(dst, &v, 4);
+		break;
+	}
+	}
+}
+
+size_t streamRecordSize(const StreamField fields[], size_t numFields)
+{
+	assert(fields);
+	size_t size = 0;
+	for (size_t i = 0; i < numFields; ++i)
+		size += STREAM_FIELD_WIDTH(fields[i].type) * fields[i].count;
+	return size;
+}
+
+bool streamReadRecord(StreamHandle hnd, void* restrict out, const StreamField fields[], size_t numFields)
+{
+	assert(out && fields);
+	uint8_t packed[STREAM_RECORD_MAX_SIZE];
+	const size_t size = streamRecordSize(fields, numFields);
+	assert(size <= STREAM_RECORD_MAX_SIZE);
+	if (streamRead(hnd, packed, 1, size) != size)
+		return false;
+
+	const uint8_t* src = packed;
+	for (size_t i = 0; i < numFields; ++i)
+	{
+		const size_t width = STREAM_FIELD_WIDTH(fields[i].type);
+		uint8_t* dst = &((uint8_t*)out)[fields[i].offset];
+		for (unsigned j = 0; j < fields[i].count; ++j, src += width, dst += width)
+			streamFieldConvert(dst, src, (StreamFieldType)fields[i].type);
+	}
+	return true;
+}
+
+bool streamWriteRecord(StreamHandle hnd, const void* restrict in, const StreamField fields[], size_t numFields)
+{
+	assert(in && fields);
+	uint8_t packed[STREAM_RECORD_MAX_SIZE];
+	const size_t size = streamRecordSize(fields, numFields);
+	assert(size <= STREAM_RECORD_MAX_SIZE);
+
+	uint8_t* dst = packed;
+	for (size_t i = 0; i < numFields; ++i)
+	{
+		const size_t width = STREAM_FIELD_WIDTH(fields[i].type);
+		const uint8_t* src = &((const uint8_t*)in)[fields[i].offset];
+		for (unsigned j = 0; j < fields[i].count; ++j, src += width, dst += width)
+			streamFieldConvert(dst, src, (StreamFieldType)fields[i].type);
+	}
+	return streamWrite(hnd, packed, 1, size) == size;
+}
@@ -3,8 +3,10 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 #include "endian.h"
+#include "util.h"
 
 typedef enum
 {
@@ -24,15 +26,18 @@ typedef struct StreamIoCb
 	// fputc, optional
 	int    (*putc)(void* restrict user, int c);
 	// Stream seek, optional, may only support STREAM_SEEK_CUR
-	bool   (*seek)(void* restrict user, long offset, StreamWhence whence);
+	bool   (*seek)(void* restrict user, int64_t offset, StreamWhence whence);
 	// Get stream position, optional
-	bool   (*tell)(void* restrict user, size_t* restrict outPosition);
+	bool   (*tell)(void* restrict user, uint64_t* restrict outPosition);
 	// True if stream has reached end-of-file, optional
 	bool   (*eof)(void* restrict user);
 	// True if stream has encountered an error
 	bool   (*error)(void* restrict user);
 	// Close & free stream, optional if stream has no hidden state to clean up
 	void   (*close)(void* restrict user);
+	// Get a pointer to up to size bytes at the current position without copying and
+	//  advance past them, optional, returns the number of bytes borrowed
+	size_t (*borrow)(void* restrict user, const void** restrict outData, size_t size);
 } StreamIoCb;
 
 typedef struct StreamHandle
@@ -43,23 +48,109 @@ typedef struct StreamHandle
 } StreamHandle;
 
 
+// Buffered stream
+
+#define STREAM_BUFFER_DEFAULT_SIZE (1024 * 64)
+
+typedef struct StreamBuffer
+{
+	StreamHandle base;
+	uint8_t* restrict data;
+	size_t size;   // Capacity of data in bytes
+	size_t pos;    // Read cursor, or number of pending bytes when writing
+	size_t fill;   // Number of valid bytes in data when reading, always 0 when writing
+	bool writing;
+	bool ownsData;
+
+} StreamBuffer;
+
+extern const StreamIoCb streamBufferCb;
+
+// Wrap base in a buffer of size bytes, uses storage if non-NULL, otherwise allocates its own.
+// Closing the returned handle flushes pending writes and closes base, but can't report a failed
+//  flush, so writers must call streamFlush & check it before closing.
+// Supports streamBorrow of whatever is buffered, borrowed data is valid until the next operation.
+int streamBufferOpen(StreamHandle* restrict outHnd, StreamHandle base, void* restrict storage, size_t size);
+bool streamBufferFlush(StreamBuffer* restrict buf);
+
+size_t streamBufferReadSlow(StreamBuffer* restrict buf, void* restrict out, size_t bytes);
+size_t streamBufferWriteSlow(StreamBuffer* restrict buf, const void* restrict in, size_t bytes);
+int streamBufferGetCSlow(StreamBuffer* restrict buf);
+int streamBufferPutCSlow(StreamBuffer* restrict buf, int c);
+
+inline StreamBuffer* streamBufferFromHandle(StreamHandle hnd)
+{
+	assert(hnd.cb == &streamBufferCb && hnd.user);
+	return (StreamBuffer*)hnd.user;
+}
+
+inline size_t streamBufferRead(StreamBuffer* restrict buf, void* restrict out, size_t size, size_t count)
+{
+	const size_t bytes = size * count;
+	if (fastPath(!buf->writing && buf->fill - buf->pos >= bytes))
+	{
+		memcpy(out, &buf->data[buf->pos], bytes);
+		buf->pos += bytes;
+		return count;
+	}
+	return size ? streamBufferReadSlow(buf, out, bytes) / size : 0;
+}
+
+inline size_t streamBufferWrite(StreamBuffer* restrict buf, const void* restrict in, size_t size, size_t count)
+{
+	const size_t bytes = size * count;
+	if (fastPath(buf->writing && buf->size - buf->pos >= bytes))
+	{
+		memcpy(&buf->data[buf->pos], in, bytes);
+		buf->pos += bytes;
+		return count;
+	}
+	return size ? streamBufferWriteSlow(buf, in, bytes) / size : 0;
+}
+
+inline int streamBufferGetC(StreamBuffer* restrict buf)
+{
+	if (fastPath(buf->pos < buf->fill))  // fill is 0 while writing
+		return (int)buf->data[buf->pos++];
+	return streamBufferGetCSlow(buf);
+}
+
+inline int streamBufferPutC(StreamBuffer* restrict buf, int c)
+{
+	if (fastPath(buf->writing && buf->pos < buf->size))
+	{
+		buf->data[buf->pos++] = (uint8_t)c;
+		return (int)(uint8_t)c;
+	}
+	return streamBufferPutCSlow(buf, c);
+}
+
+
 // Stream user interface
 
+// Buffered streams take the inline fast path instead of an indirect call per access
+
 inline size_t streamRead(StreamHandle hnd, void *restrict out, size_t size, size_t count)
 {
 	assert(hnd.cb && hnd.cb->read && out);
+	if (hnd.cb == &streamBufferCb)
+		return streamBufferRead((StreamBuffer*)hnd.user, out, size, count);
 	return hnd.cb->read(hnd.user, out, size, count);
 }
 
 inline size_t streamWrite(StreamHandle hnd, const void *restrict in, size_t size, size_t count)
 {
 	assert(hnd.cb && hnd.cb->write && in);
+	if (hnd.cb == &streamBufferCb)
+		return streamBufferWrite((StreamBuffer*)hnd.user, in, size, count);
 	return hnd.cb->write(hnd.user, in, size, count);
 }
 
 inline int streamGetC(StreamHandle hnd)
 {
 	assert(hnd.cb);
+	if (hnd.cb == &streamBufferCb)
+		return streamBufferGetC((StreamBuffer*)hnd.user);
 	if (hnd.cb->getc)
 		return hnd.cb->getc(hnd.user);
 	assert(hnd.cb->read);
@@ -70,6 +161,8 @@ inline int streamGetC(StreamHandle hnd)
 inline int streamPutC(StreamHandle hnd, int c)
 {
 	assert(hnd.cb);
+	if (hnd.cb == &streamBufferCb)
+		return streamBufferPutC((StreamBuffer*)hnd.user, c);
 	if (hnd.cb->putc)
 		return hnd.cb->putc(hnd.user, c);
 	assert(hnd.cb->write);
@@ -77,25 +170,25 @@ inline int streamPutC(StreamHandle hnd, int c)
 	return (hnd.cb->write(hnd.user, (const void*)&u, 1, 1) == 1) ? (int)c : -1;
 }
 
-inline bool streamSkip(StreamHandle hnd, long offset)
+inline bool streamSkip(StreamHandle hnd, int64_t offset)
 {
 	assert(hnd.cb);
 	if (hnd.cb->seek)
 		return hnd.cb->seek(hnd.user, offset, STREAM_SEEK_CUR);
 	assert(hnd.cb->read);
 	uint8_t tmp;
-	for (long i = 0; i < offset; ++i)
+	for (int64_t i = 0; i < offset; ++i)
 		hnd.cb->read(hnd.user, &tmp, 1, 1);
 	return true;
 }
 
-inline bool streamSeek(StreamHandle hnd, long offset, StreamWhence whence)
+inline bool streamSeek(StreamHandle hnd, int64_t offset, StreamWhence whence)
 {
 	assert(hnd.cb);
 	return hnd.cb->seek && hnd.cb->seek(hnd.user, offset, whence);
 }
 
-inline bool streamTell(StreamHandle hnd, size_t* restrict outPosition)
+inline bool streamTell(StreamHandle hnd, uint64_t* restrict outPosition)
 {
 	assert(hnd.cb && outPosition);
 	return hnd.cb->tell && hnd.cb->tell(hnd.user, outPosition);
@@ -113,19 +206,32 @@ inline bool streamError(StreamHandle hnd)
 	return hnd.cb->error && hnd.cb->error(hnd.user);
 }
 
+// Write out pending buffered data, true on success or if the stream doesn't buffer
+inline bool streamFlush(StreamHandle hnd)
+{
+	assert(hnd.cb);
+	return hnd.cb != &streamBufferCb || streamBufferFlush((StreamBuffer*)hnd.user);
+}
+
 inline void streamClose(StreamHandle hnd)
 {
 	if (hnd.user && hnd.cb && hnd.cb->close)
 		hnd.cb->close(hnd.user);
 }
 
+inline size_t streamBorrow(StreamHandle hnd, const void** restrict outData, size_t size)
+{
+	assert(hnd.cb && outData);
+	return hnd.cb->borrow ? hnd.cb->borrow(hnd.user, outData, size) : 0;
+}
+
 
 // Stream fixed reads
 
 inline size_t streamReadU32le(StreamHandle hnd, uint32_t* restrict out, size_t count)
 {
 	assert(hnd.cb && hnd.cb->read);
-	size_t r = hnd.cb->read(hnd.user, out, sizeof(uint32_t), count);
+	size_t r = streamRead(hnd, out, sizeof(uint32_t), count);
 #if BYTE_ORDER == BIG_ENDIAN
 	for (size_t i = 0; i < count; ++i)
 		out[i] = swap32(out[i]);
@@ -133,10 +239,21 @@ inline size_t streamReadU32le(StreamHandle hnd, uint32_t* restrict out, size_t c
 	return r;
 }
 
+inline size_t streamReadU64le(StreamHandle hnd, uint64_t* restrict out, size_t count)
+{
+	assert(hnd.cb && hnd.cb->read);
+	size_t r = streamRead(hnd, out, sizeof(uint64_t), count);
+#if BYTE_ORDER == BIG_ENDIAN
+	for (size_t i = 0; i < count; ++i)
+		out[i] = swap64(out[i]);
+#endif
+	return r;
+}
+
 inline size_t streamReadU32be(StreamHandle hnd, uint32_t* restrict out, size_t count)
 {
 	assert(hnd.cb && hnd.cb->read);
-	size_t r = hnd.cb->read(hnd.user, out, sizeof(uint32_t), count);
+	size_t r = streamRead(hnd, out, sizeof(uint32_t), count);
 #if BYTE_ORDER == LITTLE_ENDIAN
 	for (size_t i = 0; i < count; ++i)
 		out[i] = swap32(out[i]);
@@ -147,7 +264,7 @@ inline size_t streamReadU32be(StreamHandle hnd, uint32_t* restrict out, size_t c
 inline size_t streamReadI32le(StreamHandle hnd, int32_t* restrict out, size_t count)
 {
 	assert(hnd.cb && hnd.cb->read);
-	size_t r = hnd.cb->read(hnd.user, out, sizeof(int32_t), count);
+	size_t r = streamRead(hnd, out, sizeof(int32_t), count);
 #if BYTE_ORDER == BIG_ENDIAN
 	for (size_t i = 0; i < count; ++i)
 		out[i] = (int32_t)swap32((uint32_t)out[i]);
@@ -158,7 +275,7 @@ inline size_t streamReadI32le(StreamHandle hnd, int32_t* restrict out, size_t co
 inline size_t streamReadU16le(StreamHandle hnd, uint16_t* restrict out, size_t count)
 {
 	assert(hnd.cb && hnd.cb->read);
-	size_t r = hnd.cb->read(hnd.user, out, sizeof(uint16_t), count);
+	size_t r = streamRead(hnd, out, sizeof(uint16_t), count);
 #if BYTE_ORDER == BIG_ENDIAN
 	for (size_t i = 0; i < count; ++i)
 		out[i] = swap16(out[i]);
@@ -169,7 +286,7 @@ inline size_t streamReadU16le(StreamHandle hnd, uint16_t* restrict out, size_t c
 inline size_t streamReadU16be(StreamHandle hnd, uint16_t* restrict out, size_t count)
 {
 	assert(hnd.cb && hnd.cb->read);
-	size_t r = hnd.cb->read(hnd.user, out, sizeof(uint16_t), count);
+	size_t r = streamRead(hnd, out, sizeof(uint16_t), count);
 #if BYTE_ORDER == LITTLE_ENDIAN
 	for (size_t i = 0; i < count; ++i)
 		out[i] = swap16(out[i]);
@@ -180,7 +297,7 @@ inline size_t streamReadU16be(StreamHandle hnd, uint16_t* restrict out, size_t c
 inline size_t streamReadI16be(StreamHandle hnd, int16_t* restrict out, size_t count)
 {
 	assert(hnd.cb && hnd.cb->read);
-	size_t r = hnd.cb->read(hnd.user, out, sizeof(int16_t), count);
+	size_t r = streamRead(hnd, out, sizeof(int16_t), count);
 #if BYTE_ORDER == LITTLE_ENDIAN
 	for (size_t i = 0; i < count; ++i)
 		out[i] = (int16_t)swap16((uint16_t)out[i]);
@@ -195,46 +312,108 @@ inline size_t streamWriteU32le(StreamHandle hnd, uint32_t v)
 {
 	assert(hnd.cb && hnd.cb->write);
 	v = SWAP_LE32(v);
-	return hnd.cb->write(hnd.user, (const void*)&v, sizeof(uint32_t), 1);
+	return streamWrite(hnd, (const void*)&v, sizeof(uint32_t), 1);
+}
+
+inline size_t streamWriteU64le(StreamHandle hnd, uint64_t v)
+{
+	assert(hnd.cb && hnd.cb->write);
+	v = SWAP_LE64(v);
+	return streamWrite(hnd, (const void*)&v, sizeof(uint64_t), 1);
 }
 
 inline size_t streamWriteU32be(StreamHandle hnd, uint32_t v)
 {
 	assert(hnd.cb && hnd.cb->write);
 	v = SWAP_BE32(v);
-	return hnd.cb->write(hnd.user, (const void*)&v, sizeof(uint32_t), 1);
+	return streamWrite(hnd, (const void*)&v, sizeof(uint32_t), 1);
 }
 
 inline size_t streamWriteI32be(StreamHandle hnd, int32_t v)
 {
 	assert(hnd.cb && hnd.cb->write);
 	v = (int32_t)SWAP_BE32((uint32_t)v);
-	return hnd.cb->write(hnd.user, (const void*)&v, sizeof(int32_t), 1);
+	return streamWrite(hnd, (const void*)&v, sizeof(int32_t), 1);
 }
 
 inline size_t streamWriteU16le(StreamHandle hnd, uint16_t v)
 {
 	assert(hnd.cb && hnd.cb->write);
 	v = SWAP_LE16(v);
-	return hnd.cb->write(hnd.user, (const void*)&v, sizeof(uint16_t), 1);
+	return streamWrite(hnd, (const void*)&v, sizeof(uint16_t), 1);
 }
 
 inline size_t streamWriteU16be(StreamHandle hnd, uint16_t v)
 {
 	assert(hnd.cb && hnd.cb->write);
 	v = SWAP_BE16(v);
-	return hnd.cb->write(hnd.user, (const void*)&v, sizeof(uint16_t), 1);
+	return streamWrite(hnd, (const void*)&v, sizeof(uint16_t), 1);
 }
 
 inline size_t streamWriteI16be(StreamHandle hnd, int16_t v)
 {
 	assert(hnd.cb && hnd.cb->write);
 	v = (int16_t)SWAP_BE16((uint16_t)v);
-	return hnd.cb->write(hnd.user, (const void*)&v, sizeof(int16_t), 1);
+	return streamWrite(hnd, (const void*)&v, sizeof(int16_t), 1);
 }
 
 
+// Stream packed records
+
+typedef enum
+{
+	STREAM_FIELD_U8    = 0,
+	STREAM_FIELD_U16LE = 1,
+	STREAM_FIELD_U16BE = 2,
+	STREAM_FIELD_U32LE = 3,
+	STREAM_FIELD_U32BE = 4
+} StreamFieldType;
+
+#define STREAM_FIELD_WIDTH(TYPE) ((TYPE) == STREAM_FIELD_U8 ? 1U : (TYPE) <= STREAM_FIELD_U16BE ? 2U : 4U)
+
+// Describes one (or an array of) fixed-width field(s) in a packed on-disk record
+typedef struct StreamField
+{
+	uint8_t  type;    // StreamFieldType
+	uint16_t count;   // Number of consecutive elements
+	uint16_t offset;  // Offset of the member in the in-memory struct
+
+} StreamField;
+
+// Field descriptor for MEMBER of STRUCT, arrays are sized automatically
+#define STREAM_FIELD(TYPE, STRUCT, MEMBER) \
+	{ STREAM_FIELD_##TYPE, \
+	(uint16_t)(sizeof(((STRUCT*)0)->MEMBER) / STREAM_FIELD_WIDTH(STREAM_FIELD_##TYPE)), \
+	(uint16_t)offsetof(STRUCT, MEMBER) }
+
+#define STREAM_RECORD_MAX_SIZE 256
+
+// Packed size of a record in bytes
+size_t streamRecordSize(const StreamField fields[], size_t numFields);
+// Read a packed record with a single stream read & convert each field to native endian, returns false on short read
+bool streamReadRecord(StreamHandle hnd, void* restrict out, const StreamField fields[], size_t numFields);
+// Pack & write a record with a single stream write, returns false on short write
+bool streamWriteRecord(StreamHandle hnd, const void* restrict in, const StreamField fields[], size_t numFields);
+
+
 // Open file stream with platform native IO
 int streamFileOpen(StreamHandle* restrict outHnd, const char* restrict path, const char* restrict mode);
+// Open file stream with platform IO buffering replaced by a StreamBuffer of bufferSize bytes
+int streamFileOpenBuffered(StreamHandle* restrict outHnd, const char* restrict path, const char* restrict mode,
+	size_t bufferSize);
+// Open buffered write stream over stdout, which is switched to binary mode and flushed but not closed on close
+int streamFileOpenStdout(StreamHandle* restrict outHnd, size_t bufferSize);
+// Open read-only memory mapped file stream, supports streamBorrow
+int streamMapOpen(StreamHandle* restrict outHnd, const char* restrict path);
+
+// Open stream over a fixed caller owned buffer, the first length bytes are readable
+//  and writes may extend it up to capacity bytes, supports streamBorrow
+int streamMemOpen(StreamHandle* restrict outHnd, void* restrict data, size_t capacity, size_t length);
+// Open in-memory stream that grows as it's written to, supports streamBorrow.
+// If outData is non-NULL it receives the malloc'd contents (and outLength their size) on close.
+int streamMemArenaOpen(StreamHandle* restrict outHnd, size_t reserve,
+	void** restrict outData, size_t* restrict outLength);
+// Get contents of a memory stream, the pointer is valid until the next write or close
+const void* streamMemData(StreamHandle hnd, size_t* restrict outLength);
 
 #endif//STREAM_H
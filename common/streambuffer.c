@@ -0,0 +1,252 @@
+/* streambuffer.c (c) 2025 a dinosaur (zlib) */
+
+#include "stream.h"
+#include <stdlib.h>
+#include <errno.h>
+
+
+static bool streamBufferBeginWrite(StreamBuffer* restrict buf)
+{
+	if (buf->writing)
+		return true;
+
+	// Rewind the base stream over any read-ahead that hasn't been consumed
+	if (buf->pos < buf->fill && !streamSeek(buf->base, -(int64_t)(buf->fill - buf->pos), STREAM_SEEK_CUR))
+		return false;
+	buf->pos = buf->fill = 0;
+	buf->writing = true;
+	return true;
+}
+
+static bool streamBufferBeginRead(StreamBuffer* restrict buf)
+{
+	if (!buf->writing)
+		return true;
+	if (!streamBufferFlush(buf))
+		return false;
+	buf->writing = false;
+	return true;
+}
+
+static bool streamBufferRefill(StreamBuffer* restrict buf)
+{
+	assert(!buf->writing && buf->pos >= buf->fill);
+	buf->pos  = 0;
+	buf->fill = streamRead(buf->base, buf->data, 1, buf->size);
+	return buf->fill > 0;
+}
+
+bool streamBufferFlush(StreamBuffer* restrict buf)
+{
+	assert(buf);
+	if (!buf->writing || !buf->pos)
+		return true;
+	const size_t pending = buf->pos;
+	buf->pos = 0;
+	return streamWrite(buf->base, buf->data, 1, pending) == pending;
+}
+
+size_t streamBufferReadSlow(StreamBuffer* restrict buf, void* restrict out, size_t bytes)
+{
+	assert(buf && out);
+	if (!streamBufferBeginRead(buf))
+		return 0;
+
+	// Drain whatever is left in the buffer
+	uint8_t* dst = (uint8_t*)out;
+	size_t avail = MIN(buf->fill - buf->pos, bytes);
+	memcpy(dst, &buf->data[buf->pos], avail);
+	buf->pos += avail;
+	size_t total = avail;
+
+	// Large reads bypass the buffer entirely
+	if (bytes - total >= buf->size)
+		return total + streamRead(buf->base, &dst[total], 1, bytes - total);
+
+	while (total < bytes && streamBufferRefill(buf))
+	{
+		avail = MIN(buf->fill, bytes - total);
+		memcpy(&dst[total], buf->data, avail);
+		buf->pos = avail;
+		total += avail;
+	}
+	return total;
+}
+
+size_t streamBufferWriteSlow(StreamBuffer* restrict buf, const void* restrict in, size_t bytes)
+{
+	assert(buf && in);
+	if (!streamBufferBeginWrite(buf))
+		return 0;
+
+	if (bytes > buf->size - buf->pos && !streamBufferFlush(buf))
+		return 0;
+
+	// Large writes bypass the buffer entirely
+	if (bytes >= buf->size)
+		return streamWrite(buf->base, in, 1, bytes);
+
+	memcpy(&buf->data[buf->pos], in, bytes);
+	buf->pos += bytes;
+	return bytes;
+}
+
+int streamBufferGetCSlow(StreamBuffer* restrict buf)
+{
+	assert(buf);
+	if (!streamBufferBeginRead(buf) || !streamBufferRefill(buf))
+		return -1;
+	return (int)buf->data[buf->pos++];
+}
+
+int streamBufferPutCSlow(StreamBuffer* restrict buf, int c)
+{
+	assert(buf);
+	if (!streamBufferBeginWrite(buf) || (buf->pos >= buf->size && !streamBufferFlush(buf)))
+		return -1;
+	buf->data[buf->pos++] = (uint8_t)c;
+	return (int)(uint8_t)c;
+}
+
+
+static size_t streamBufferCbRead(void* restrict user, void* restrict out, size_t size, size_t num)
+{
+	assert(user);
+	return streamBufferRead((StreamBuffer*)user, out, size, num);
+}
+
+static size_t streamBufferCbWrite(void* restrict user, const void* restrict src, size_t size, size_t num)
+{
+	assert(user);
+	return streamBufferWrite((StreamBuffer*)user, src, size, num);
+}
+
+static int streamBufferCbGetC(void* restrict user)
+{
+	assert(user);
+	return streamBufferGetC((StreamBuffer*)user);
+}
+
+static int streamBufferCbPutC(void* restrict user, int c)
+{
+	assert(user);
+	return streamBufferPutC((StreamBuffer*)user, c);
+}
+
+static bool streamBufferCbSeek(void* restrict user, int64_t offset, StreamWhence whence)
+{
+	assert(user);
+	StreamBuffer* buf = (StreamBuffer*)user;
+	if (buf->writing)
+	{
+		if (!streamBufferFlush(buf))
+			return false;
+	}
+	else if (whence == STREAM_SEEK_CUR)
+	{
+		// Relative seeks that land inside the read buffer don't touch the base stream
+		const int64_t ahead = (int64_t)(buf->fill - buf->pos);
+		if (offset >= -(int64_t)buf->pos && offset <= ahead)
+		{
+			buf->pos = (size_t)((int64_t)buf->pos + offset);
+			return true;
+		}
+		offset -= ahead;
+	}
+	buf->pos = buf->fill = 0;
+	return streamSeek(buf->base, offset, whence);
+}
+
+static bool streamBufferCbTell(void* restrict user, uint64_t* restrict outPosition)
+{
+	assert(user);
+	StreamBuffer* buf = (StreamBuffer*)user;
+	uint64_t pos;
+	if (!streamTell(buf->base, &pos))
+		return false;
+	*outPosition = buf->writing ? pos + buf->pos : pos - (buf->fill - buf->pos);
+	return true;
+}
+
+static bool streamBufferCbEof(void* restrict user)
+{
+	assert(user);
+	StreamBuffer* buf = (StreamBuffer*)user;
+	return !buf->writing && buf->pos >= buf->fill && streamEOF(buf->base);
+}
+
+static bool streamBufferCbError(void* restrict user)
+{
+	assert(user);
+	return streamError(((StreamBuffer*)user)->base);
+}
+
+static size_t streamBufferCbBorrow(void* restrict user, const void** restrict outData, size_t size)
+{
+	assert(user && outData);
+	StreamBuffer* buf = (StreamBuffer*)user;
+	if (!streamBufferBeginRead(buf) || (buf->pos >= buf->fill && !streamBufferRefill(buf)))
+		return 0;
+	size = MIN(size, buf->fill - buf->pos);
+	*outData = &buf->data[buf->pos];
+	buf->pos += size;
+	return size;
+}
+
+static void streamBufferCbClose(void* restrict user)
+{
+	if (!user)
+		return;
+	StreamBuffer* buf = (StreamBuffer*)user;
+	streamBufferFlush(buf);  // Too late to report failure, writers flush & check beforehand
+	streamClose(buf->base);
+	if (buf->ownsData)
+		free(buf->data);
+	free(buf);
+}
+
+const StreamIoCb streamBufferCb =
+{
+	.read   = streamBufferCbRead,
+	.write  = streamBufferCbWrite,
+	.getc   = streamBufferCbGetC,
+	.putc   = streamBufferCbPutC,
+	.seek   = streamBufferCbSeek,
+	.tell   = streamBufferCbTell,
+	.eof    = streamBufferCbEof,
+	.error  = streamBufferCbError,
+	.close  = streamBufferCbClose,
+	.borrow = streamBufferCbBorrow
+};
+
+
+int streamBufferOpen(StreamHandle* restrict outHnd, StreamHandle base, void* restrict storage, size_t size)
+{
+	assert(outHnd && base.cb && size);
+	StreamBuffer* buf = malloc(sizeof(StreamBuffer));
+	if (!buf)
+		return ENOMEM;
+
+	(*buf) = (StreamBuffer)
+	{
+		.base     = base,
+		.data     = storage ? (uint8_t*)storage : malloc(size),
+		.size     = size,
+		.pos      = 0,
+		.fill     = 0,
+		.writing  = false,
+		.ownsData = !storage
+	};
+	if (!buf->data)
+	{
+		free(buf);
+		return ENOMEM;
+	}
+
+	(*outHnd) = (StreamHandle)
+	{
+		.user = (void*)buf,
+		.cb = (const StreamIoCb* restrict)&streamBufferCb
+	};
+	return 0;
+}
@@ -1,8 +1,14 @@
 /* streamfile.c (c) 2023, 2025 a dinosaur (zlib) */
 
+#define _FILE_OFFSET_BITS 64  // 64-bit off_t for fseeko/ftello on 32-bit glibc
+
 #include "stream.h"
 #include <stdio.h>
 #include <errno.h>
+#ifdef _WIN32
+# include <io.h>
+# include <fcntl.h>
+#endif
 
 
 static size_t streamFileRead(void* restrict user, void* restrict out, size_t size, size_t num)
@@ -29,7 +35,12 @@ static int streamFilePutC(void* restrict user, int c)
 	return putc(c, (FILE*)user);
 }
 
-static bool streamFileSeek(void* restrict user, long offset, StreamWhence whence)
+#ifdef _MSC_VER
+# define fseeko _fseeki64
+# define ftello _ftelli64
+#endif
+
+static bool streamFileSeek(void* restrict user, int64_t offset, StreamWhence whence)
 {
 	assert(user);
 	int seek;
@@ -40,16 +51,16 @@ static bool streamFileSeek(void* restrict user, long offset, StreamWhence whence
 	case STREAM_SEEK_END: seek = SEEK_END; break;
 	default: return false;
 	}
-	return fseek((FILE*)user, offset, seek) ? false : true;
+	return fseeko((FILE*)user, offset, seek) ? false : true;
 }
 
-static bool streamFileTell(void* restrict user, size_t* restrict outPosition)
+static bool streamFileTell(void* restrict user, uint64_t* restrict outPosition)
 {
 	assert(user);
-	const long pos = ftell((FILE*)user);
-	if (pos == -1L)
+	const int64_t pos = ftello((FILE*)user);
+	if (pos < 0)
 		return false;
-	*outPosition = (size_t)pos;
+	*outPosition = (uint64_t)pos;
 	return true;
 }
 
@@ -84,6 +95,24 @@ static const StreamIoCb streamFileCb =
 	.close = streamFileClose
 };
 
+static void streamFileStdClose(void* restrict user)
+{
+	if (user)
+		fflush((FILE*)user);
+}
+
+// Standard streams are flushed rather than closed and usually can't seek
+static const StreamIoCb streamFileStdCb =
+{
+	.read  = streamFileRead,
+	.write = streamFileWrite,
+	.getc  = streamFileGetC,
+	.putc  = streamFilePutC,
+	.eof   = streamFileEof,
+	.error = streamFileError,
+	.close = streamFileStdClose
+};
+
 
 int streamFileOpen(StreamHandle* restrict outHnd, const char* restrict path, const char* restrict mode)
 {
@@ -106,3 +135,35 @@ int streamFileOpen(StreamHandle* restrict outHnd, const char* restrict path, con
 	}
 	return err;
 }
+
+int streamFileOpenBuffered(StreamHandle* restrict outHnd, const char* restrict path, const char* restrict mode,
+	size_t bufferSize)
+{
+	assert(outHnd);
+	StreamHandle file;
+	int err = streamFileOpen(&file, path, mode);
+	if (err)
+		return err;
+
+	// The stream buffer takes over from stdio buffering
+	setvbuf((FILE*)file.user, NULL, _IONBF, 0);
+	if ((err = streamBufferOpen(outHnd, file, NULL, bufferSize)))
+		streamClose(file);
+	return err;
+}
+
+int streamFileOpenStdout(StreamHandle* restrict outHnd, size_t bufferSize)
+{
+	assert(outHnd);
+#ifdef _WIN32
+	if (_setmode(_fileno(stdout), _O_BINARY) == -1)
+		return EBADF;
+#endif
+	setvbuf(stdout, NULL, _IONBF, 0);
+	const StreamHandle file =
+	{
+		.user = (void*)stdout,
+		.cb = (const StreamIoCb* restrict)&streamFileStdCb
+	};
+	return streamBufferOpen(outHnd, file, NULL, bufferSize);
+}
@@ -0,0 +1,216 @@
+/* streammap.c (c) 2025 a dinosaur (zlib) */
+
+#define _FILE_OFFSET_BITS 64  // Report sizes of large files correctly on 32-bit hosts
+
+#include "stream.h"
+#include <stdlib.h>
+#include <errno.h>
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
+
+
+typedef struct StreamMap
+{
+	const uint8_t* data;
+	size_t size, pos;
+	bool eof;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#endif
+
+} StreamMap;
+
+static size_t streamMapRead(void* restrict user, void* restrict out, size_t size, size_t num)
+{
+	assert(user);
+	StreamMap* map = (StreamMap*)user;
+	if (!size)
+		return 0;
+	const size_t count = MIN(num, (map->size - map->pos) / size);
+	if (count)
+		memcpy(out, &map->data[map->pos], size * count);
+	map->pos += size * count;
+	if (count < num)
+		map->eof = true;
+	return count;
+}
+
+static int streamMapGetC(void* restrict user)
+{
+	assert(user);
+	StreamMap* map = (StreamMap*)user;
+	if (slowPath(map->pos >= map->size))
+	{
+		map->eof = true;
+		return -1;
+	}
+	return (int)map->data[map->pos++];
+}
+
+static bool streamMapSeek(void* restrict user, int64_t offset, StreamWhence whence)
+{
+	assert(user);
+	StreamMap* map = (StreamMap*)user;
+	size_t origin;
+	switch (whence)
+	{
+	case STREAM_SEEK_SET: origin = 0; break;
+	case STREAM_SEEK_CUR: origin = map->pos; break;
+	case STREAM_SEEK_END: origin = map->size; break;
+	default: return false;
+	}
+	if ((offset < 0 && (uint64_t)-offset > origin) || (offset > 0 && (uint64_t)offset > map->size - origin))
+		return false;
+	map->pos = (size_t)((int64_t)origin + offset);
+	map->eof = false;
+	return true;
+}
+
+static bool streamMapTell(void* restrict user, uint64_t* restrict outPosition)
+{
+	assert(user);
+	*outPosition = ((StreamMap*)user)->pos;
+	return true;
+}
+
+static bool streamMapEof(void* restrict user)
+{
+	assert(user);
+	return ((StreamMap*)user)->eof;
+}
+
+static bool streamMapError(void* restrict user)
+{
+	return false;
+}
+
+static size_t streamMapBorrow(void* restrict user, const void** restrict outData, size_t size)
+{
+	assert(user && outData);
+	StreamMap* map = (StreamMap*)user;
+	if (map->pos >= map->size)
+	{
+		map->eof = true;
+		return 0;
+	}
+	size = MIN(size, map->size - map->pos);
+	*outData = &map->data[map->pos];
+	map->pos += size;
+	return size;
+}
+
+static void streamMapClose(void* restrict user)
+{
+	if (!user)
+		return;
+	StreamMap* map = (StreamMap*)user;
+#ifdef _WIN32
+	if (map->data)
+		UnmapViewOfFile(map->data);
+	if (map->mapping)
+		CloseHandle(map->mapping);
+	CloseHandle(map->file);
+#else
+	if (map->data)
+		munmap((void*)map->data, map->size);
+#endif
+	free(map);
+}
+
+static const StreamIoCb streamMapCb =
+{
+	.read   = streamMapRead,
+	.write  = NULL,
+	.getc   = streamMapGetC,
+	.putc   = NULL,
+	.seek   = streamMapSeek,
+	.tell   = streamMapTell,
+	.eof    = streamMapEof,
+	.error  = streamMapError,
+	.close  = streamMapClose,
+	.borrow = streamMapBorrow
+};
+
+
+int streamMapOpen(StreamHandle* restrict outHnd, const char* restrict path)
+{
+	assert(outHnd && path);
+	StreamMap* map = calloc(1, sizeof(StreamMap));
+	if (!map)
+		return ENOMEM;
+
+#ifdef _WIN32
+	map->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+		OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (map->file == INVALID_HANDLE_VALUE)
+	{
+		free(map);
+		return ENOENT;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(map->file, &size) || (uint64_t)size.QuadPart > SIZE_MAX)
+	{
+		streamMapClose(map);
+		return EFBIG;
+	}
+	map->size = (size_t)size.QuadPart;
+	// Mapping an empty file is an error, so leave the stream empty instead
+	if (map->size)
+	{
+		map->mapping = CreateFileMappingA(map->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		map->data = map->mapping ? MapViewOfFile(map->mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (!map->data)
+		{
+			streamMapClose(map);
+			return EIO;
+		}
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+	{
+		int err = errno;
+		errno = 0;
+		free(map);
+		return err;
+	}
+	struct stat st;
+	if (fstat(fd, &st) || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > SIZE_MAX)
+	{
+		close(fd);
+		free(map);
+		return EINVAL;
+	}
+	map->size = (size_t)st.st_size;
+	// Mapping an empty file is an error, so leave the stream empty instead
+	if (map->size)
+	{
+		void* data = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED)
+		{
+			int err = errno;
+			errno = 0;
+			close(fd);
+			free(map);
+			return err;
+		}
+		posix_madvise(data, map->size, POSIX_MADV_SEQUENTIAL);
+		map->data = (const uint8_t*)data;
+	}
+	close(fd);  // The mapping holds its own reference to the file
+#endif
+
+	(*outHnd) = (StreamHandle)
+	{
+		.user = (void*)map,
+		.cb = (const StreamIoCb* restrict)&streamMapCb
+	};
+	return 0;
+}
@@ -0,0 +1,250 @@
+/* streammem.c (c) 2025 a dinosaur (zlib) */
+
+#include "stream.h"
+#include <stdlib.h>
+#include <errno.h>
+
+
+typedef struct StreamMem
+{
+	uint8_t* data;
+	size_t length;    // Number of valid bytes
+	size_t capacity;  // Allocated or caller provided size of data
+	size_t pos;
+	bool growable, eof, error;
+	void** outData;     // Receives ownership of arena data on close, if non-NULL
+	size_t* outLength;
+
+} StreamMem;
+
+static bool streamMemReserve(StreamMem* restrict mem, size_t size)
+{
+	if (size <= mem->capacity)
+		return true;
+	if (!mem->growable)
+		return false;
+
+	size_t newCapacity = MAX(mem->capacity, 64);
+	while (newCapacity < size)
+	{
+		if (newCapacity > SIZE_MAX / 2)
+		{
+			newCapacity = size;
+			break;
+		}
+		newCapacity *= 2;
+	}
+	uint8_t* newData = realloc(mem->data, newCapacity);
+	if (!newData)
+		return false;
+	mem->data = newData;
+	mem->capacity = newCapacity;
+	return true;
+}
+
+static size_t streamMemRead(void* restrict user, void* restrict out, size_t size, size_t num)
+{
+	assert(user);
+	StreamMem* mem = (StreamMem*)user;
+	if (!size)
+		return 0;
+	const size_t avail = mem->pos < mem->length ? mem->length - mem->pos : 0;
+	const size_t count = MIN(num, avail / size);
+	if (count)
+		memcpy(out, &mem->data[mem->pos], size * count);
+	mem->pos += size * count;
+	if (count < num)
+		mem->eof = true;
+	return count;
+}
+
+static size_t streamMemWrite(void* restrict user, const void* restrict src, size_t size, size_t num)
+{
+	assert(user);
+	StreamMem* mem = (StreamMem*)user;
+	if (!size)
+		return 0;
+	size_t count = num;
+	if (!streamMemReserve(mem, mem->pos + size * num))
+	{
+		// Fixed buffers take as many whole items as will fit
+		count = mem->capacity > mem->pos ? MIN(num, (mem->capacity - mem->pos) / size) : 0;
+		mem->error = true;
+	}
+	if (count)
+		memcpy(&mem->data[mem->pos], src, size * count);
+	mem->pos += size * count;
+	mem->length = MAX(mem->length, mem->pos);
+	return count;
+}
+
+static int streamMemGetC(void* restrict user)
+{
+	assert(user);
+	StreamMem* mem = (StreamMem*)user;
+	if (slowPath(mem->pos >= mem->length))
+	{
+		mem->eof = true;
+		return -1;
+	}
+	return (int)mem->data[mem->pos++];
+}
+
+static int streamMemPutC(void* restrict user, int c)
+{
+	const uint8_t u = (uint8_t)c;
+	return streamMemWrite(user, &u, 1, 1) ? (int)u : -1;
+}
+
+static bool streamMemSeek(void* restrict user, int64_t offset, StreamWhence whence)
+{
+	assert(user);
+	StreamMem* mem = (StreamMem*)user;
+	size_t origin;
+	switch (whence)
+	{
+	case STREAM_SEEK_SET: origin = 0; break;
+	case STREAM_SEEK_CUR: origin = mem->pos; break;
+	case STREAM_SEEK_END: origin = mem->length; break;
+	default: return false;
+	}
+	if ((offset < 0 && (uint64_t)-offset > origin) || (offset > 0 && (uint64_t)offset > mem->length - origin))
+		return false;
+	mem->pos = (size_t)((int64_t)origin + offset);
+	mem->eof = false;
+	return true;
+}
+
+static bool streamMemTell(void* restrict user, uint64_t* restrict outPosition)
+{
+	assert(user);
+	*outPosition = ((StreamMem*)user)->pos;
+	return true;
+}
+
+static bool streamMemEof(void* restrict user)
+{
+	assert(user);
+	return ((StreamMem*)user)->eof;
+}
+
+static bool streamMemError(void* restrict user)
+{
+	assert(user);
+	return ((StreamMem*)user)->error;
+}
+
+static size_t streamMemBorrow(void* restrict user, const void** restrict outData, size_t size)
+{
+	assert(user && outData);
+	StreamMem* mem = (StreamMem*)user;
+	if (mem->pos >= mem->length)
+	{
+		mem->eof = true;
+		return 0;
+	}
+	size = MIN(size, mem->length - mem->pos);
+	*outData = &mem->data[mem->pos];
+	mem->pos += size;
+	return size;
+}
+
+static void streamMemClose(void* restrict user)
+{
+	if (!user)
+		return;
+	StreamMem* mem = (StreamMem*)user;
+	if (mem->growable)
+	{
+		if (mem->outData)
+		{
+			*mem->outData = mem->data;
+			if (mem->outLength)
+				*mem->outLength = mem->length;
+		}
+		else
+		{
+			free(mem->data);
+		}
+	}
+	free(mem);
+}
+
+static const StreamIoCb streamMemCb =
+{
+	.read   = streamMemRead,
+	.write  = streamMemWrite,
+	.getc   = streamMemGetC,
+	.putc   = streamMemPutC,
+	.seek   = streamMemSeek,
+	.tell   = streamMemTell,
+	.eof    = streamMemEof,
+	.error  = streamMemError,
+	.close  = streamMemClose,
+	.borrow = streamMemBorrow
+};
+
+
+static int streamMemOpenInternal(StreamHandle* restrict outHnd, StreamMem mem)
+{
+	StreamMem* user = malloc(sizeof(StreamMem));
+	if (!user)
+		return ENOMEM;
+	(*user) = mem;
+	(*outHnd) = (StreamHandle)
+	{
+		.user = (void*)user,
+		.cb = (const StreamIoCb* restrict)&streamMemCb
+	};
+	return 0;
+}
+
+int streamMemOpen(StreamHandle* restrict outHnd, void* restrict data, size_t capacity, size_t length)
+{
+	assert(outHnd && (data || !capacity) && length <= capacity);
+	return streamMemOpenInternal(outHnd, (StreamMem)
+	{
+		.data     = (uint8_t*)data,
+		.length   = length,
+		.capacity = capacity,
+		.pos      = 0,
+		.growable = false,
+		.eof      = false,
+		.error    = false,
+		.outData   = NULL,
+		.outLength = NULL
+	});
+}
+
+int streamMemArenaOpen(StreamHandle* restrict outHnd, size_t reserve,
+	void** restrict outData, size_t* restrict outLength)
+{
+	assert(outHnd);
+	StreamMem mem =
+	{
+		.data     = NULL,
+		.length   = 0,
+		.capacity = 0,
+		.pos      = 0,
+		.growable = true,
+		.eof      = false,
+		.error    = false,
+		.outData   = outData,
+		.outLength = outLength
+	};
+	if (reserve && !streamMemReserve(&mem, reserve))
+		return ENOMEM;
+	int err = streamMemOpenInternal(outHnd, mem);
+	if (err)
+		free(mem.data);
+	return err;
+}
+
+const void* streamMemData(StreamHandle hnd, size_t* restrict outLength)
+{
+	assert(hnd.cb == &streamMemCb && hnd.user);
+	const StreamMem* mem = (const StreamMem*)hnd.user;
+	if (outLength)
+		*outLength = mem->length;
+	return mem->data;
+}
@@ -0,0 +1,214 @@
+/* threadpool.c (c) 2025 a dinosaur (zlib) */
+
+#include "threadpool.h"
+#include <stdbool.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <errno.h>
+#ifdef _WIN32
+# define WIN32_LEAN_AND_MEAN
+# include <windows.h>
+#else
+# include <pthread.h>
+# include <unistd.h>
+#endif
+
+
+#ifdef _WIN32
+typedef SRWLOCK            Mutex;
+typedef CONDITION_VARIABLE Cond;
+typedef HANDLE             Thread;
+# define mutexInit(M)       InitializeSRWLock((M))
+# define mutexDestroy(M)    (void)(M)
+# define mutexLock(M)       AcquireSRWLockExclusive((M))
+# define mutexUnlock(M)     ReleaseSRWLockExclusive((M))
+# define condInit(C)        InitializeConditionVariable((C))
+# define condDestroy(C)     (void)(C)
+# define condWait(C, M)     SleepConditionVariableSRW((C), (M), INFINITE, 0)
+# define condSignal(C)      WakeConditionVariable((C))
+# define condBroadcast(C)   WakeAllConditionVariable((C))
+#else
+typedef pthread_mutex_t    Mutex;
+typedef pthread_cond_t     Cond;
+typedef pthread_t          Thread;
+# define mutexInit(M)       pthread_mutex_init((M), NULL)
+# define mutexDestroy(M)    pthread_mutex_destroy((M))
+# define mutexLock(M)       pthread_mutex_lock((M))
+# define mutexUnlock(M)     pthread_mutex_unlock((M))
+# define condInit(C)        pthread_cond_init((C), NULL)
+# define condDestroy(C)     pthread_cond_destroy((C))
+# define condWait(C, M)     pthread_cond_wait((C), (M))
+# define condSignal(C)      pthread_cond_signal((C))
+# define condBroadcast(C)   pthread_cond_broadcast((C))
+#endif
+
+typedef struct
+{
+	ThreadPoolTask func;
+	void* user;
+
+} Task;
+
+struct ThreadPool
+{
+	Mutex lock;
+	Cond notEmpty, notFull, idle;
+	Task* queue;
+	int capacity, head, count;
+	int busy;  // Tasks queued or running
+	bool stopping;
+	int numThreads;
+	Thread threads[];
+};
+
+
+static void threadPoolWorker(ThreadPool* pool)
+{
+	mutexLock(&pool->lock);
+	for (;;)
+	{
+		while (!pool->count && !pool->stopping)
+			condWait(&pool->notEmpty, &pool->lock);
+		if (!pool->count)
+			break;
+
+		const Task task = pool->queue[pool->head];
+		pool->head = (pool->head + 1) % pool->capacity;
+		--pool->count;
+		condSignal(&pool->notFull);
+		mutexUnlock(&pool->lock);
+
+		task.func(task.user);
+
+		mutexLock(&pool->lock);
+		if (!--pool->busy)
+			condBroadcast(&pool->idle);
+	}
+	mutexUnlock(&pool->lock);
+}
+
+#ifdef _WIN32
+static DWORD WINAPI threadPoolEntry(LPVOID user)
+{
+	threadPoolWorker((ThreadPool*)user);
+	return 0;
+}
+#else
+static void* threadPoolEntry(void* user)
+{
+	threadPoolWorker((ThreadPool*)user);
+	return NULL;
+}
+#endif
+
+
+int threadPoolDefaultThreads(void)
+{
+#ifdef _WIN32
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (int)n : 1;
+#endif
+}
+
+int threadPoolCreate(ThreadPool** restrict outPool, int numThreads, int queueCapacity)
+{
+	assert(outPool && numThreads >= 0 && queueCapacity > 0);
+	if (!numThreads)
+		numThreads = threadPoolDefaultThreads();
+
+	ThreadPool* pool = malloc(sizeof(ThreadPool) + sizeof(Thread) * numThreads);
+	if (!pool)
+		return ENOMEM;
+	pool->queue = malloc(sizeof(Task) * queueCapacity);
+	if (!pool->queue)
+	{
+		free(pool);
+		return ENOMEM;
+	}
+	pool->capacity = queueCapacity;
+	pool->head = pool->count = pool->busy = 0;
+	pool->stopping = false;
+	pool->numThreads = 0;
+	mutexInit(&pool->lock);
+	condInit(&pool->notEmpty);
+	condInit(&pool->notFull);
+	condInit(&pool->idle);
+
+	for (int i = 0; i < numThreads; ++i)
+	{
+#ifdef _WIN32
+		pool->threads[i] = CreateThread(NULL, 0, threadPoolEntry, pool, 0, NULL);
+		if (!pool->threads[i])
+#else
+		if (pthread_create(&pool->threads[i], NULL, threadPoolEntry, pool))
+#endif
+		{
+			// Run with whatever workers did start, only fail outright if none did
+			if (!i)
+			{
+				threadPoolDestroy(pool);
+				return EAGAIN;
+			}
+			break;
+		}
+		++pool->numThreads;
+	}
+
+	*outPool = pool;
+	return 0;
+}
+
+int threadPoolSubmit(ThreadPool* restrict pool, ThreadPoolTask task, void* user)
+{
+	assert(pool && task);
+	mutexLock(&pool->lock);
+	while (pool->count == pool->capacity)
+		condWait(&pool->notFull, &pool->lock);
+	pool->queue[(pool->head + pool->count) % pool->capacity] = (Task){ .func = task, .user = user };
+	++pool->count;
+	++pool->busy;
+	condSignal(&pool->notEmpty);
+	mutexUnlock(&pool->lock);
+	return 0;
+}
+
+void threadPoolWait(ThreadPool* restrict pool)
+{
+	assert(pool);
+	mutexLock(&pool->lock);
+	while (pool->busy)
+		condWait(&pool->idle, &pool->lock);
+	mutexUnlock(&pool->lock);
+}
+
+void threadPoolDestroy(ThreadPool* restrict pool)
+{
+	if (!pool)
+		return;
+
+	// Workers drain the queue before noticing the stop flag
+	mutexLock(&pool->lock);
+	pool->stopping = true;
+	condBroadcast(&pool->notEmpty);
+	mutexUnlock(&pool->lock);
+	for (int i = 0; i < pool->numThreads; ++i)
+	{
+#ifdef _WIN32
+		WaitForSingleObject(pool->threads[i], INFINITE);
+		CloseHandle(pool->threads[i]);
+#else
+		pthread_join(pool->threads[i], NULL);
+#endif
+	}
+
+	condDestroy(&pool->idle);
+	condDestroy(&pool->notFull);
+	condDestroy(&pool->notEmpty);
+	mutexDestroy(&pool->lock);
+	free(pool->queue);
+	free(pool);
+}
@@ -0,0 +1,22 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stddef.h>
+
+typedef void (*ThreadPoolTask)(void* user);
+typedef struct ThreadPool ThreadPool;
+
+// Number of hardware threads, at least 1
+int threadPoolDefaultThreads(void);
+
+// Start numThreads workers (0 = hardware threads) with room for queueCapacity pending tasks,
+//  bounding work in flight to numThreads running plus queueCapacity queued
+int threadPoolCreate(ThreadPool** restrict outPool, int numThreads, int queueCapacity);
+// Queue a task, blocking while the queue is full
+int threadPoolSubmit(ThreadPool* restrict pool, ThreadPoolTask task, void* user);
+// Block until every submitted task has finished
+void threadPoolWait(ThreadPool* restrict pool);
+// Finish outstanding tasks, stop the workers & free the pool
+void threadPoolDestroy(ThreadPool* restrict pool);
+
+#endif//THREADPOOL_H
@@ -2,6 +2,12 @@
 
 #include "wave.h"
 #include "wavedefs.h"
+#include "interleave.h"
+#include "pcm.h"
+#include <stdlib.h>
+
+
+#define WAVE_STAGING_SIZE 0x10000
 
 
 static void writeRiffChunk(StreamHandle hnd, IffFourCC fourcc, uint32_t size)
@@ -10,57 +16,213 @@ static void writeRiffChunk(StreamHandle hnd, IffFourCC fourcc, uint32_t size)
 	streamWriteU32le(hnd, size);
 }
 
-static void writeFormatChunk(StreamHandle hnd, const FormatChunk* fmt)
+static const StreamField formatChunkFields[] =
+{
+	STREAM_FIELD(U16LE, FormatChunk, format),
+	STREAM_FIELD(U16LE, FormatChunk, channels),
+	STREAM_FIELD(U32LE, FormatChunk, samplerate),
+	STREAM_FIELD(U32LE, FormatChunk, byterate),
+	STREAM_FIELD(U16LE, FormatChunk, alignment),
+	STREAM_FIELD(U16LE, FormatChunk, bitdepth)
+};
+
+static const StreamField formatExtensibleFields[] =
+{
+	STREAM_FIELD(U16LE, FormatExtensible, extraSize),
+	STREAM_FIELD(U16LE, FormatExtensible, validBits),
+	STREAM_FIELD(U32LE, FormatExtensible, channelMask),
+	STREAM_FIELD(U32LE, FormatExtensible, subFormat),
+	STREAM_FIELD(U16LE, FormatExtensible, subFormatData2),
+	STREAM_FIELD(U16LE, FormatExtensible, subFormatData3),
+	STREAM_FIELD(U8,    FormatExtensible, subFormatData4)
+};
+
+static const StreamField iffChunkFields[] =
+{
+	STREAM_FIELD(U8,    IffChunk, fourcc),
+	STREAM_FIELD(U32LE, IffChunk, size)
+};
+
+static const StreamField samplerChunkFields[] =
+{
+	STREAM_FIELD(U32LE, SamplerChunk, manufacturer),
+	STREAM_FIELD(U32LE, SamplerChunk, product),
+	STREAM_FIELD(U32LE, SamplerChunk, samplePeriod),
+	STREAM_FIELD(U32LE, SamplerChunk, midiUnityNote),
+	STREAM_FIELD(U32LE, SamplerChunk, midiPitchFrac),
+	STREAM_FIELD(U32LE, SamplerChunk, smpteFormat),
+	STREAM_FIELD(U32LE, SamplerChunk, smpteOffset),
+	STREAM_FIELD(U32LE, SamplerChunk, sampleLoopCount),
+	STREAM_FIELD(U32LE, SamplerChunk, sampleData)
+};
+
+static const StreamField sampleLoopFields[] =
+{
+	STREAM_FIELD(U32LE, SampleLoopChunk, id),
+	STREAM_FIELD(U32LE, SampleLoopChunk, type),
+	STREAM_FIELD(U32LE, SampleLoopChunk, loopStart),
+	STREAM_FIELD(U32LE, SampleLoopChunk, loopEnd),
+	STREAM_FIELD(U32LE, SampleLoopChunk, fraction),
+	STREAM_FIELD(U32LE, SampleLoopChunk, playCount)
+};
+
+// Default speaker assignments for mono through 7.1
+static const uint32_t defaultChannelMasks[] =
 {
-	writeRiffChunk(hnd, WAVE_FOURCC_FMT, FORMAT_CHUNK_SIZE);
-	streamWriteU16le(hnd, fmt->format);
-	streamWriteU16le(hnd, fmt->channels);
-	streamWriteU32le(hnd, fmt->samplerate);
-	streamWriteU32le(hnd, fmt->byterate);
-	streamWriteU16le(hnd, fmt->alignment);
-	streamWriteU16le(hnd, fmt->bitdepth);
+	0x004, 0x003, 0x007, 0x033, 0x037, 0x03F, 0x13F, 0x63F
+};
+
+static bool useExtensibleFormat(const WaveSpec* spec)
+{
+	return spec->channels > 2 || (spec->format == WAVESPEC_FORMAT_PCM && spec->bytedepth > 2);
 }
 
-static int waveWriteHeader(const WaveSpec* spec, size_t dataLen, StreamHandle hnd)
+static uint32_t formatChunkSize(const WaveSpec* spec)
 {
-	if (!spec || !dataLen || dataLen >= UINT32_MAX || !hnd.cb || !hnd.cb->write)
-		return 1;
+	if (useExtensibleFormat(spec))
+		return FORMAT_CHUNK_EXTENSIBLE_SIZE;
+	return spec->format == WAVESPEC_FORMAT_PCM ? FORMAT_CHUNK_SIZE : FORMAT_CHUNK_EX_SIZE;
+}
 
-	if (spec->format != WAVESPEC_FORMAT_PCM)
-		return 1;
-	if (spec->channels <= 0 || spec->channels >= INT16_MAX)
-		return 1;
-	if (spec->format == WAVESPEC_FORMAT_PCM && (spec->bytedepth <= 0 || spec->bytedepth > 4))
-		return 1;
+static bool needsFactChunk(const WaveSpec* spec)
+{
+	return spec->format != WAVESPEC_FORMAT_PCM;
+}
 
-	// write riff container
-	writeRiffChunk(hnd, FOURCC_RIFF, sizeof(uint32_t) * 5 + FORMAT_CHUNK_SIZE + (uint32_t)dataLen);
-	streamWrite(hnd, FOURCC_WAVE.c, 1, 4);
+static void writeDataSize64Chunk(StreamHandle hnd, const DataSize64Chunk* ds64)
+{
+	writeRiffChunk(hnd, WAVE_FOURCC_DS64, DS64_CHUNK_SIZE);
+	streamWriteU64le(hnd, ds64->riffSize);
+	streamWriteU64le(hnd, ds64->dataSize);
+	streamWriteU64le(hnd, ds64->sampleCount);
+	streamWriteU32le(hnd, ds64->tableLength);
+}
 
-	WAVEFmt sampleFmt;
+static bool waveSpecValid(const WaveSpec* spec)
+{
+	if (spec->channels <= 0 || spec->channels >= INT16_MAX)
+		return false;
 	switch (spec->format)
 	{
-		case WAVESPEC_FORMAT_PCM:
-			sampleFmt = WAVE_FMT_PCM;
-			break;
-		case WAVESPEC_FORMAT_FLOAT:
-			sampleFmt = WAVE_FMT_IEEE_FLOAT;
-			break;
+	case WAVESPEC_FORMAT_PCM:   return spec->bytedepth > 0 && spec->bytedepth <= 4;
+	case WAVESPEC_FORMAT_FLOAT: return spec->bytedepth == 4 || spec->bytedepth == 8;
+	default: return false;
 	}
+}
+
+static void writeFormatChunk(StreamHandle hnd, const WaveSpec* spec)
+{
+	const WAVEFmt sampleFmt = spec->format == WAVESPEC_FORMAT_FLOAT ? WAVE_FMT_IEEE_FLOAT : WAVE_FMT_PCM;
+	const bool extensible = useExtensibleFormat(spec);
 
-	writeFormatChunk(hnd, &(const FormatChunk)
+	writeRiffChunk(hnd, WAVE_FOURCC_FMT, formatChunkSize(spec));
+	streamWriteRecord(hnd, &(const FormatChunk)
 	{
-		.format     = sampleFmt,
+		.format     = extensible ? WAVE_FMT_EXTENSIBLE : sampleFmt,
 		.channels   = (uint16_t)spec->channels,
 		.samplerate = spec->rate,
 		.byterate   = spec->rate * spec->channels * spec->bytedepth,
 		.alignment  = (uint16_t)(spec->channels * spec->bytedepth),
 		.bitdepth   = (uint16_t)spec->bytedepth * 8
-	});
+	}, formatChunkFields, sizeof(formatChunkFields) / sizeof(StreamField));
+
+	if (extensible)
+	{
+		streamWriteRecord(hnd, &(const FormatExtensible)
+		{
+			.extraSize      = FORMAT_EXTENSIBLE_EXTRA_SIZE,
+			.validBits      = (uint16_t)spec->bytedepth * 8,
+			.channelMask    = spec->channels <= 8 ? defaultChannelMasks[spec->channels - 1] : 0,
+			.subFormat      = sampleFmt,
+			.subFormatData2 = WAVE_SUBFORMAT_DATA2,
+			.subFormatData3 = WAVE_SUBFORMAT_DATA3,
+			.subFormatData4 = WAVE_SUBFORMAT_DATA4
+		}, formatExtensibleFields, sizeof(formatExtensibleFields) / sizeof(StreamField));
+	}
+	else if (spec->format != WAVESPEC_FORMAT_PCM)
+	{
+		streamWriteU16le(hnd, 0);
+	}
+}
+
+static int writeSamples(StreamHandle hnd, const void* data, int bytedepth, size_t count)
+{
+	// WAVE is little endian, so only big endian hosts need to go through a staging buffer
+	if (PCM_NATIVE_ENDIAN == PCM_LITTLE_ENDIAN || bytedepth == 1)
+		return streamWrite(hnd, data, bytedepth, count) == count ? 0 : 1;
+
+	const size_t chunkSamples = MIN(count, WAVE_STAGING_SIZE / (size_t)bytedepth);
+	if (!chunkSamples)
+		return 0;
+	uint8_t* staging = malloc(chunkSamples * bytedepth);
+	if (!staging)
+		return 1;
+
+	for (size_t offset = 0; offset < count; offset += chunkSamples)
+	{
+		const size_t n = MIN(chunkSamples, count - offset);
+		pcmSwap(staging, &((const uint8_t*)data)[offset * bytedepth], bytedepth, n);
+		if (streamWrite(hnd, staging, bytedepth, n) != n)
+		{
+			free(staging);
+			return 1;
+		}
+	}
+
+	free(staging);
+	return 0;
+}
+
+static int waveWriteHeader(const WaveSpec* spec, uint64_t dataLen, StreamHandle hnd)
+{
+	if (!spec || !dataLen || !hnd.cb || !hnd.cb->write)
+		return 1;
+	if (!waveSpecValid(spec))
+		return 1;
+
+	// Promote to RF64 when the RIFF size field would overflow
+	const bool fact = needsFactChunk(spec);
+	const uint64_t sampleCount = dataLen / ((uint64_t)spec->channels * spec->bytedepth);
+	const uint64_t riffSize = sizeof(uint32_t) * 5 + formatChunkSize(spec)
+		+ (fact ? IFF_CHUNK_HEAD_SIZE + FACT_CHUNK_SIZE : 0) + dataLen;
+	bool rf64 = spec->container == WAVESPEC_CONTAINER_RF64;
+	if (riffSize >= RF64_SIZE_PLACEHOLDER)
+	{
+		if (spec->container == WAVESPEC_CONTAINER_RIFF)
+			return 1;
+		rf64 = true;
+	}
+
+	// write riff container
+	if (rf64)
+	{
+		writeRiffChunk(hnd, FOURCC_RF64, RF64_SIZE_PLACEHOLDER);
+		streamWrite(hnd, FOURCC_WAVE.c, 1, 4);
+		writeDataSize64Chunk(hnd, &(const DataSize64Chunk)
+		{
+			.riffSize    = riffSize + IFF_CHUNK_HEAD_SIZE + DS64_CHUNK_SIZE,
+			.dataSize    = dataLen,
+			.sampleCount = sampleCount,
+			.tableLength = 0
+		});
+	}
+	else
+	{
+		writeRiffChunk(hnd, FOURCC_RIFF, (uint32_t)riffSize);
+		streamWrite(hnd, FOURCC_WAVE.c, 1, 4);
+	}
+
+	writeFormatChunk(hnd, spec);
+	if (fact)
+	{
+		// RF64 keeps the real count in 'ds64'
+		writeRiffChunk(hnd, WAVE_FOURCC_FACT, FACT_CHUNK_SIZE);
+		streamWriteU32le(hnd, rf64 ? RF64_SIZE_PLACEHOLDER : (uint32_t)sampleCount);
+	}
 
 	// write data chunk
 	streamWrite(hnd, WAVE_FOURCC_DATA.c, 1, 4);
-	streamWriteU32le(hnd, (uint32_t)dataLen);
+	streamWriteU32le(hnd, rf64 ? RF64_SIZE_PLACEHOLDER : (uint32_t)dataLen);
 
 	return 0;
 }
@@ -73,11 +235,9 @@ int waveWrite(const WaveSpec* spec, const void* data, size_t dataLen, StreamHand
 	int res = waveWriteHeader(spec, dataLen, hnd);
 	if (res)
 		return res;
-	//FIXME: not endian safe
-	if (data)
-		streamWrite(hnd, data, 1, dataLen);
-
-	return 0;
+	if (!data)
+		return 0;
+	return writeSamples(hnd, data, spec->bytedepth, dataLen / spec->bytedepth);
 }
 
 int waveWriteBlock(const WaveSpec* spec, const void* blocks[], size_t blockLen, StreamHandle hnd)
@@ -85,23 +245,40 @@ int waveWriteBlock(const WaveSpec* spec, const void* blocks[], size_t blockLen,
 	assert(spec && blocks);
 
 	// Write RIFF/Wave header to file
-	int res = waveWriteHeader(spec, blockLen * spec->channels, hnd);
+	int res = waveWriteHeader(spec, (uint64_t)blockLen * spec->channels, hnd);
 	if (res)
 		return res;
 
-	// Copy & interleave
-	//FIXME: not endian safe
-	for (size_t i = 0; i < blockLen / spec->bytedepth; ++i)
-		for (int j = 0; j < spec->channels; ++j)
-			streamWrite(hnd, &((const char**)blocks)[j][i * spec->bytedepth], spec->bytedepth, 1);
+	// Interleave through a bounded staging buffer so each chunk goes out as a single write
+	const size_t frameSize = (size_t)spec->channels * spec->bytedepth;
+	const size_t frames = blockLen / spec->bytedepth;
+	const size_t chunkFrames = MIN(frames, MAX(1, WAVE_STAGING_SIZE / frameSize));
+	if (!chunkFrames)
+		return 0;
+	uint8_t* staging = malloc(chunkFrames * frameSize);
+	if (!staging)
+		return 1;
 
+	for (size_t offset = 0; offset < frames; offset += chunkFrames)
+	{
+		const size_t count = MIN(chunkFrames, frames - offset);
+		interleave(staging, blocks, spec->channels, spec->bytedepth, offset, count);
+		pcmConvert(staging, staging, spec->bytedepth, count * spec->channels, PCM_NATIVE_ENDIAN, PCM_LITTLE_ENDIAN);
+		if (streamWrite(hnd, staging, frameSize, count) != count)
+		{
+			free(staging);
+			return 1;
+		}
+	}
+
+	free(staging);
 	return 0;
 }
 
 int waveWriteFile(const WaveSpec* spec, const void* data, size_t dataLen, const char* path)
 {
 	StreamHandle hnd;
-	if (streamFileOpen(&hnd, path, "wb"))
+	if (streamFileOpenBuffered(&hnd, path, "wb", STREAM_BUFFER_DEFAULT_SIZE))
 		return 1;
 
 	int res = waveWrite(spec, data, dataLen, hnd);
@@ -112,10 +289,369 @@ int waveWriteFile(const WaveSpec* spec, const void* data, size_t dataLen, const
 int waveWriteBlockFile(const WaveSpec* spec, const void* blocks[], size_t blockLen, const char* path)
 {
 	StreamHandle hnd;
-	if (streamFileOpen(&hnd, path, "wb"))
+	if (streamFileOpenBuffered(&hnd, path, "wb", STREAM_BUFFER_DEFAULT_SIZE))
 		return 1;
 
 	int res = waveWriteBlock(spec, blocks, blockLen, hnd);
 	streamClose(hnd);
 	return res;
 }
+
+
+int waveWriterOpen(WaveWriter* restrict writer, const WaveSpec* restrict spec, StreamHandle hnd)
+{
+	assert(writer && spec && hnd.cb);
+	if (!hnd.cb->write || !waveSpecValid(spec))
+		return 1;
+
+	// The header is written with zero sizes that are back-patched on close
+	uint64_t riffOffset, dataOffset;
+	if (!streamTell(hnd, &riffOffset))
+		return 1;
+	writeRiffChunk(hnd, FOURCC_RIFF, 0);
+	streamWrite(hnd, FOURCC_WAVE.c, 1, 4);
+
+	// Reserve room for a 'ds64' chunk in case the data outgrows RIFF (EBU Tech 3306)
+	const bool reserved = spec->container != WAVESPEC_CONTAINER_RIFF;
+	if (reserved)
+	{
+		const uint8_t zeroes[DS64_CHUNK_SIZE] = { 0 };
+		writeRiffChunk(hnd, WAVE_FOURCC_JUNK, DS64_CHUNK_SIZE);
+		streamWrite(hnd, zeroes, 1, DS64_CHUNK_SIZE);
+	}
+
+	writeFormatChunk(hnd, spec);
+	uint64_t factOffset = 0;
+	if (needsFactChunk(spec))
+	{
+		writeRiffChunk(hnd, WAVE_FOURCC_FACT, FACT_CHUNK_SIZE);
+		if (!streamTell(hnd, &factOffset))
+			return 1;
+		streamWriteU32le(hnd, 0);
+	}
+	writeRiffChunk(hnd, WAVE_FOURCC_DATA, 0);
+	if (!streamTell(hnd, &dataOffset))
+		return 1;
+
+	(*writer) = (WaveWriter)
+	{
+		.hnd        = hnd,
+		.spec       = *spec,
+		.riffOffset = riffOffset,
+		.dataOffset = dataOffset,
+		.dataLength = 0,
+		.factOffset = factOffset,
+		.reserved   = reserved
+	};
+	return 0;
+}
+
+int waveWriterFileOpen(WaveWriter* restrict writer, const WaveSpec* restrict spec, const char* restrict path)
+{
+	StreamHandle hnd;
+	if (streamFileOpenBuffered(&hnd, path, "wb", STREAM_BUFFER_DEFAULT_SIZE))
+		return 1;
+
+	int res = waveWriterOpen(writer, spec, hnd);
+	if (res)
+		streamClose(hnd);
+	return res;
+}
+
+int waveWriterAppendFrames(WaveWriter* restrict writer, const void* restrict frames, size_t count)
+{
+	assert(writer && (frames || !count));
+	if (!count)
+		return 0;
+
+	const int res = writeSamples(writer->hnd, frames, writer->spec.bytedepth, count * writer->spec.channels);
+	if (!res)
+		writer->dataLength += (uint64_t)count * writer->spec.channels * writer->spec.bytedepth;
+	return res;
+}
+
+int waveWriterClose(WaveWriter* restrict writer)
+{
+	assert(writer);
+	StreamHandle hnd = writer->hnd;
+	const uint64_t dataLen = writer->dataLength;
+
+	// Data chunk is padded to an even length, the pad byte counts towards the RIFF size
+	if (IFF_NEEDS_PAD(dataLen))
+		streamPutC(hnd, '\0');
+	const uint64_t riffSize = writer->dataOffset - writer->riffOffset - IFF_CHUNK_HEAD_SIZE
+		+ dataLen + (dataLen & 0x1);
+	const uint64_t sampleCount = dataLen / ((uint64_t)writer->spec.channels * writer->spec.bytedepth);
+
+	int res = 0;
+	const bool rf64 = writer->spec.container == WAVESPEC_CONTAINER_RF64 || riffSize >= RF64_SIZE_PLACEHOLDER;
+	if (rf64)
+	{
+		// Promote to RF64 by rewriting the header & turning the reserved 'JUNK' chunk into 'ds64'
+		if (!writer->reserved || !streamSeek(hnd, (int64_t)writer->riffOffset, STREAM_SEEK_SET))
+		{
+			res = 1;
+		}
+		else
+		{
+			writeRiffChunk(hnd, FOURCC_RF64, RF64_SIZE_PLACEHOLDER);
+			streamWrite(hnd, FOURCC_WAVE.c, 1, 4);
+			writeDataSize64Chunk(hnd, &(const DataSize64Chunk)
+			{
+				.riffSize    = riffSize,
+				.dataSize    = dataLen,
+				.sampleCount = sampleCount,
+				.tableLength = 0
+			});
+			if (streamSeek(hnd, (int64_t)writer->dataOffset - 4, STREAM_SEEK_SET))
+				streamWriteU32le(hnd, RF64_SIZE_PLACEHOLDER);
+			else
+				res = 1;
+		}
+	}
+	else
+	{
+		if (streamSeek(hnd, (int64_t)writer->riffOffset + 4, STREAM_SEEK_SET))
+			streamWriteU32le(hnd, (uint32_t)riffSize);
+		else
+			res = 1;
+		if (streamSeek(hnd, (int64_t)writer->dataOffset - 4, STREAM_SEEK_SET))
+			streamWriteU32le(hnd, (uint32_t)dataLen);
+		else
+			res = 1;
+	}
+	if (writer->factOffset)
+	{
+		// RF64 keeps the real count in 'ds64'
+		if (streamSeek(hnd, (int64_t)writer->factOffset, STREAM_SEEK_SET))
+			streamWriteU32le(hnd, rf64 ? RF64_SIZE_PLACEHOLDER : (uint32_t)sampleCount);
+		else
+			res = 1;
+	}
+
+	// Flush here as close can't report failure, then catch any write that failed along the way
+	if (!streamFlush(hnd))
+		res = 1;
+	if (streamError(hnd))
+		res = 1;
+	streamClose(hnd);
+	return res;
+}
+
+
+static int readFormatChunk(WaveReader* restrict reader, uint32_t size)
+{
+	FormatChunk fmt;
+	if (size < FORMAT_CHUNK_SIZE
+		|| !streamReadRecord(reader->hnd, &fmt, formatChunkFields, sizeof(formatChunkFields) / sizeof(StreamField)))
+		return 1;
+	uint32_t consumed = FORMAT_CHUNK_SIZE;
+
+	WAVEFmt format = fmt.format;
+	int bitdepth = fmt.bitdepth;
+	if (format == WAVE_FMT_EXTENSIBLE)
+	{
+		FormatExtensible ext;
+		if (size < FORMAT_CHUNK_EXTENSIBLE_SIZE || !streamReadRecord(reader->hnd, &ext,
+			formatExtensibleFields, sizeof(formatExtensibleFields) / sizeof(StreamField)))
+			return 1;
+		consumed = FORMAT_CHUNK_EXTENSIBLE_SIZE;
+		format = (WAVEFmt)ext.subFormat;
+		if (ext.validBits)
+			bitdepth = ext.validBits;
+	}
+
+	const WaveSpec spec =
+	{
+		.format    = format == WAVE_FMT_IEEE_FLOAT ? WAVESPEC_FORMAT_FLOAT : WAVESPEC_FORMAT_PCM,
+		.channels  = fmt.channels,
+		.rate      = fmt.samplerate,
+		.bytedepth = (fmt.bitdepth + 7) / 8,
+		.container = reader->spec.container
+	};
+	if ((format != WAVE_FMT_PCM && format != WAVE_FMT_IEEE_FLOAT) || !waveSpecValid(&spec))
+		return 1;
+
+	reader->spec = spec;
+	reader->bitdepth = bitdepth;
+	return streamSkip(reader->hnd, size - consumed) ? 0 : 1;
+}
+
+static int readSamplerChunk(WaveReader* restrict reader, uint32_t size)
+{
+	SamplerChunk* smpl = &reader->sampler;
+	if (size < SMPL_CHUNK_HEAD_SIZE
+		|| !streamReadRecord(reader->hnd, smpl, samplerChunkFields, sizeof(samplerChunkFields) / sizeof(StreamField)))
+		return 1;
+	if ((uint64_t)smpl->sampleLoopCount * SAMPLER_LOOP_SIZE > size - SMPL_CHUNK_HEAD_SIZE)
+		return 1;
+
+	// Keep the first few loops, the rest are only skipped over
+	SampleLoopChunk loop;
+	for (uint32_t i = 0; i < smpl->sampleLoopCount; ++i)
+	{
+		if (!streamReadRecord(reader->hnd, &loop, sampleLoopFields, sizeof(sampleLoopFields) / sizeof(StreamField)))
+			return 1;
+		if (i < WAVE_READER_MAX_LOOPS)
+			reader->loops[i] = loop;
+	}
+
+	// Vendor data is ignored, some apps set the size field incorrectly anyway
+	reader->hasSampler = true;
+	return streamSkip(reader->hnd, size - SMPL_CHUNK_HEAD_SIZE - smpl->sampleLoopCount * SAMPLER_LOOP_SIZE) ? 0 : 1;
+}
+
+int waveReaderOpen(WaveReader* restrict reader, StreamHandle hnd)
+{
+	assert(reader && hnd.cb && hnd.cb->read);
+	(*reader) = (WaveReader)
+	{
+		.hnd        = hnd,
+		.spec       = { .container = WAVESPEC_CONTAINER_RIFF },
+		.bitdepth   = 0,
+		.dataOffset = 0,
+		.dataLength = 0,
+		.dataRemaining = 0,
+		.hasSampler = false
+	};
+
+	// Offsets are tracked while walking chunks, so streams that can't tell (like pipes) are
+	//  only limited to stopping at the data chunk
+	uint64_t start = 0;
+	const bool seekable = streamTell(hnd, &start);
+
+	// Read & verify header
+	IffChunk riff;
+	IffFourCC filetype;
+	if (!streamReadRecord(hnd, &riff, iffChunkFields, sizeof(iffChunkFields) / sizeof(StreamField))
+		|| streamRead(hnd, filetype.c, 1, 4) != 4)
+		return 1;
+	const bool rf64 = IFF_FOURCC_CMP(riff.fourcc, FOURCC_RF64) || IFF_FOURCC_CMP(riff.fourcc, FOURCC_BW64);
+	if ((!rf64 && !IFF_FOURCC_CMP(riff.fourcc, FOURCC_RIFF)) || !IFF_FOURCC_CMP(filetype, FOURCC_WAVE))
+		return 1;
+	if (rf64)
+		reader->spec.container = WAVESPEC_CONTAINER_RF64;
+
+	// Walk every chunk once, the data chunk is only noted so metadata that follows it is still found
+	uint64_t riffSize = rf64 ? UINT64_MAX : riff.size, dataSize64 = 0, pos = 4;
+	bool haveFormat = false, haveData = false, atData = false;
+	while (pos + IFF_CHUNK_HEAD_SIZE <= riffSize)
+	{
+		IffChunk chunk;
+		if (!streamReadRecord(hnd, &chunk, iffChunkFields, sizeof(iffChunkFields) / sizeof(StreamField)))
+			break;
+		uint64_t size = chunk.size;
+
+		int res = 0;
+		if (rf64 && IFF_FOURCC_CMP(chunk.fourcc, WAVE_FOURCC_DS64))
+		{
+			if (size < 16 || streamReadU64le(hnd, &riffSize, 1) != 1 || streamReadU64le(hnd, &dataSize64, 1) != 1)
+				return 1;
+			res = streamSkip(hnd, (int64_t)size - 16) ? 0 : 1;
+		}
+		else if (IFF_FOURCC_CMP(chunk.fourcc, WAVE_FOURCC_FMT))
+		{
+			res = readFormatChunk(reader, chunk.size);
+			haveFormat = !res;
+		}
+		else if (IFF_FOURCC_CMP(chunk.fourcc, WAVE_FOURCC_SMPL))
+		{
+			res = readSamplerChunk(reader, chunk.size);
+		}
+		else if (IFF_FOURCC_CMP(chunk.fourcc, WAVE_FOURCC_DATA))
+		{
+			if (rf64 && chunk.size == RF64_SIZE_PLACEHOLDER)
+				size = dataSize64;
+			reader->dataOffset = start + IFF_CHUNK_HEAD_SIZE + pos + IFF_CHUNK_HEAD_SIZE;
+			reader->dataLength = size;
+			haveData = true;
+
+			// Streams that can't seek must stop here, losing any metadata after the samples
+			if (!seekable || !streamSeek(hnd, (int64_t)(size + (size & 0x1)), STREAM_SEEK_CUR))
+			{
+				atData = true;
+				break;
+			}
+			pos += IFF_CHUNK_HEAD_SIZE + size + (size & 0x1);
+			continue;
+		}
+		else
+		{
+			res = streamSkip(hnd, (int64_t)size) ? 0 : 1;
+		}
+		if (res)
+			return res;
+
+		if (size & 0x1)
+			streamSkip(hnd, 1);
+		pos += IFF_CHUNK_HEAD_SIZE + size + (size & 0x1);
+	}
+
+	if (!haveFormat || !haveData)
+		return 1;
+
+	// Rewind to the first sample unless the walk stopped there
+	if (!atData && !streamSeek(hnd, (int64_t)reader->dataOffset, STREAM_SEEK_SET))
+		return 1;
+
+	const uint64_t frameSize = (uint64_t)reader->spec.channels * reader->spec.bytedepth;
+	reader->dataRemaining = reader->dataLength - reader->dataLength % frameSize;
+	return 0;
+}
+
+int waveReaderFileOpen(WaveReader* restrict reader, const char* restrict path)
+{
+	// Prefer mapping the file so samples can be borrowed without copying
+	StreamHandle hnd;
+	if (streamMapOpen(&hnd, path) && streamFileOpenBuffered(&hnd, path, "rb", STREAM_BUFFER_DEFAULT_SIZE))
+		return 1;
+
+	int res = waveReaderOpen(reader, hnd);
+	if (res)
+		streamClose(hnd);
+	return res;
+}
+
+size_t waveReaderReadFrames(WaveReader* restrict reader, void* restrict frames, size_t count)
+{
+	assert(reader && (frames || !count));
+	const size_t frameSize = (size_t)reader->spec.channels * reader->spec.bytedepth;
+	count = (size_t)MIN((uint64_t)count, reader->dataRemaining / frameSize);
+	if (!count)
+		return 0;
+
+	const size_t read = streamRead(reader->hnd, frames, frameSize, count);
+	reader->dataRemaining -= (uint64_t)read * frameSize;
+	pcmConvert(frames, frames, reader->spec.bytedepth, read * reader->spec.channels,
+		PCM_LITTLE_ENDIAN, PCM_NATIVE_ENDIAN);
+	return read;
+}
+
+size_t waveReaderBorrowFrames(WaveReader* restrict reader, const void** restrict outFrames, size_t count)
+{
+	assert(reader && outFrames);
+
+	// Samples can only be lent out as-is if they're already in host order
+	if (PCM_NATIVE_ENDIAN != PCM_LITTLE_ENDIAN && reader->spec.bytedepth > 1)
+		return 0;
+
+	const size_t frameSize = (size_t)reader->spec.channels * reader->spec.bytedepth;
+	count = (size_t)MIN((uint64_t)count, reader->dataRemaining / frameSize);
+	if (!count || count > SIZE_MAX / frameSize)
+		return 0;
+
+	const size_t borrowed = streamBorrow(reader->hnd, outFrames, count * frameSize);
+	if (borrowed % frameSize)
+	{
+		// Truncated mid-frame, give back the partial frame so a later read sees consistent state
+		streamSeek(reader->hnd, -(int64_t)(borrowed % frameSize), STREAM_SEEK_CUR);
+	}
+	reader->dataRemaining -= borrowed - borrowed % frameSize;
+	return borrowed / frameSize;
+}
+
+void waveReaderClose(WaveReader* restrict reader)
+{
+	assert(reader);
+	streamClose(reader->hnd);
+}
@@ -6,6 +6,7 @@ extern "C" {
 #endif
 
 #include "stream.h"
+#include "wavedefs.h"
 
 typedef enum
 {
@@ -13,19 +14,71 @@ typedef enum
 	WAVESPEC_FORMAT_FLOAT = 0x0003
 } WaveSpecFormat;
 
+typedef enum
+{
+	WAVESPEC_CONTAINER_AUTO = 0,  // RIFF, or RF64 if the data doesn't fit in 4 GiB
+	WAVESPEC_CONTAINER_RIFF = 1,
+	WAVESPEC_CONTAINER_RF64 = 2
+} WaveSpecContainer;
+
 typedef struct
 {
-	WaveSpecFormat format;
-	int            channels;
-	unsigned       rate;
-	int            bytedepth;
+	WaveSpecFormat    format;
+	int               channels;
+	unsigned          rate;
+	int               bytedepth;
+	WaveSpecContainer container;
 } WaveSpec;
 
+// Samples are taken in host byte order and written little endian, 8-bit samples are unsigned.
+//  Float output takes 4 or 8 byte IEEE samples, WAVE_FORMAT_EXTENSIBLE is used for >2 channels or >16-bit PCM.
 int waveWrite(const WaveSpec* spec, const void* data, size_t dataLen, StreamHandle hnd);
 int waveWriteFile(const WaveSpec* spec, const void* data, size_t dataLen, const char* path);
 int waveWriteBlock(const WaveSpec* spec, const void* blocks[], size_t blockLen, StreamHandle hnd);
 int waveWriteBlockFile(const WaveSpec* spec, const void* blocks[], size_t blockLen, const char* path);
 
+// Streaming writer for audio of unknown length, RIFF & data sizes are back-patched on close.
+//  Unless RIFF is forced, space for 'ds64' is reserved so that output over 4 GiB becomes RF64.
+typedef struct
+{
+	StreamHandle hnd;
+	WaveSpec     spec;
+	uint64_t     riffOffset;  // Stream position of the RIFF header
+	uint64_t     dataOffset;  // Stream position of the first sample
+	uint64_t     dataLength;
+	uint64_t     factOffset;  // Stream position of the 'fact' sample count, 0 for PCM
+	bool         reserved;
+} WaveWriter;
+
+int waveWriterOpen(WaveWriter* restrict writer, const WaveSpec* restrict spec, StreamHandle hnd);
+int waveWriterFileOpen(WaveWriter* restrict writer, const WaveSpec* restrict spec, const char* restrict path);
+int waveWriterAppendFrames(WaveWriter* restrict writer, const void* restrict frames, size_t count);
+int waveWriterClose(WaveWriter* restrict writer);
+
+#define WAVE_READER_MAX_LOOPS 4
+
+// Chunk walking reader that streams frames of the data chunk in caller-sized blocks
+typedef struct
+{
+	StreamHandle    hnd;
+	WaveSpec        spec;
+	int             bitdepth;       // Significant bits per sample
+	uint64_t        dataOffset;     // Stream position of the first sample
+	uint64_t        dataLength;     // Size of the data chunk in bytes
+	uint64_t        dataRemaining;  // Bytes of whole frames left to read
+	bool            hasSampler;
+	SamplerChunk    sampler;
+	SampleLoopChunk loops[WAVE_READER_MAX_LOOPS];  // Leading loops of the sampler chunk
+} WaveReader;
+
+int waveReaderOpen(WaveReader* restrict reader, StreamHandle hnd);
+int waveReaderFileOpen(WaveReader* restrict reader, const char* restrict path);
+// Read up to count frames converted to host byte order, returns the number of frames read
+size_t waveReaderReadFrames(WaveReader* restrict reader, void* restrict frames, size_t count);
+// Lend up to count frames straight from the stream if it supports borrowing & no conversion is needed
+size_t waveReaderBorrowFrames(WaveReader* restrict reader, const void** restrict outFrames, size_t count);
+void waveReaderClose(WaveReader* restrict reader);
+
 #ifdef __cplusplus
 }
 #endif
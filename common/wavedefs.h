@@ -4,10 +4,16 @@
 #include "iff.h"
 
 #define FOURCC_WAVE IFF_FOURCC('W', 'A', 'V', 'E')
+#define FOURCC_RF64 IFF_FOURCC('R', 'F', '6', '4')
+#define FOURCC_BW64 IFF_FOURCC('B', 'W', '6', '4')
 
 #define WAVE_FOURCC_FMT  IFF_FOURCC('f', 'm', 't', ' ')
 #define WAVE_FOURCC_DATA IFF_FOURCC('d', 'a', 't', 'a')
 
+#define WAVE_FOURCC_DS64 IFF_FOURCC('d', 's', '6', '4')
+#define WAVE_FOURCC_JUNK IFF_FOURCC('J', 'U', 'N', 'K')
+
+#define WAVE_FOURCC_FACT IFF_FOURCC('f', 'a', 'c', 't')
 #define WAVE_FOURCC_SMPL IFF_FOURCC('s', 'm', 'p', 'l')
 //#define WAVE_FOURCC_INST IFF_FOURCC('i', 'n', 's', 't')
 
@@ -33,6 +39,45 @@ typedef struct
 
 } FormatChunk;
 
+// Non-PCM formats append an extension size to the format chunk, even when it's empty
+#define FORMAT_CHUNK_EX_SIZE 18
+
+// WAVE_FORMAT_EXTENSIBLE is required for more than 2 channels or samples wider than 16 bits
+#define FORMAT_CHUNK_EXTENSIBLE_SIZE 40
+#define FORMAT_EXTENSIBLE_EXTRA_SIZE 22
+typedef struct
+{
+	uint16_t extraSize;       // Size of the extension following this field (22)
+	uint16_t validBits;       // Significant bits per sample
+	uint32_t channelMask;     // Speaker position bits, in channel order
+	uint32_t subFormat;       // First GUID field holds the WAVEFmt, the rest is constant
+	uint16_t subFormatData2;
+	uint16_t subFormatData3;
+	uint8_t  subFormatData4[8];
+
+} FormatExtensible;
+
+// KSDATAFORMAT_SUBTYPE_* GUIDs are {xxxxxxxx-0000-0010-8000-00AA00389B71}
+#define WAVE_SUBFORMAT_DATA2 0x0000
+#define WAVE_SUBFORMAT_DATA3 0x0010
+#define WAVE_SUBFORMAT_DATA4 { 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 }
+
+// Every format but PCM is followed by a 'fact' chunk holding the number of sample frames
+#define FACT_CHUNK_SIZE 4
+
+// RF64/BW64 chunk sizes that don't fit in 32 bits are stored as 0xFFFFFFFF & moved to 'ds64'
+#define RF64_SIZE_PLACEHOLDER UINT32_MAX
+
+#define DS64_CHUNK_SIZE 28
+typedef struct
+{
+	uint64_t riffSize;     // Size of RF64 container
+	uint64_t dataSize;     // Size of data chunk
+	uint64_t sampleCount;  // Number of sample frames
+	uint32_t tableLength;  // Number of additional chunk sizes following (unused)
+
+} DataSize64Chunk;
+
 #define SMPL_CHUNK_HEAD_SIZE 36
 typedef struct
 {
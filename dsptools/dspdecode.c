@@ -31,19 +31,41 @@ typedef struct
 
 } DspHeader;
 
+static const StreamField dspHeaderFields[] =
+{
+	STREAM_FIELD(U32BE, DspHeader, numSamples),
+	STREAM_FIELD(U32BE, DspHeader, numNibbles),
+	STREAM_FIELD(U32BE, DspHeader, sampleRate),
+	STREAM_FIELD(U16BE, DspHeader, loopFlag),
+	STREAM_FIELD(U16BE, DspHeader, format),
+	STREAM_FIELD(U32BE, DspHeader, loopBeg),
+	STREAM_FIELD(U32BE, DspHeader, loopEnd),
+	STREAM_FIELD(U32BE, DspHeader, curAddress),
+	STREAM_FIELD(U16BE, DspHeader, coefs),
+	STREAM_FIELD(U16BE, DspHeader, gain),
+	STREAM_FIELD(U16BE, DspHeader, predScale),
+	STREAM_FIELD(U16BE, DspHeader, history),
+	STREAM_FIELD(U16BE, DspHeader, loopPredScale),
+	STREAM_FIELD(U16BE, DspHeader, loopHistory),
+	STREAM_FIELD(U16BE, DspHeader, channels),
+	STREAM_FIELD(U16BE, DspHeader, blockSize),
+	STREAM_FIELD(U16BE, DspHeader, reserved1)
+};
+
 typedef struct
 {
-	int16_t* pcm;
-	size_t pcmSize;
+	void* pcm;
+	size_t pcmSize;  // In bytes
 	uint32_t rate;
 } PcmFile;
 
 #define PCMFILE_CLEAR() (PcmFile){ NULL, 0, 0 }
 
-static int loadDsp(const char* path, PcmFile* out)
+static int loadDsp(const char* path, PcmFile* out, bool asFloat)
 {
+	// Prefer mapping the file so ADPCM data can be decoded in place
 	StreamHandle file;
-	if (streamFileOpen(&file, path, "rb"))
+	if (streamMapOpen(&file, path) && streamFileOpenBuffered(&file, path, "rb", STREAM_BUFFER_DEFAULT_SIZE))
 	{
 		fprintf(stderr, "File not found\n");
 		return 1;
@@ -53,38 +75,33 @@ static int loadDsp(const char* path, PcmFile* out)
 	out->pcm = NULL;
 
 	DspHeader dsp;
-	streamReadU32be(file, &dsp.numSamples,     1);
-	streamReadU32be(file, &dsp.numNibbles,     1);
-	streamReadU32be(file, &dsp.sampleRate,     1);
-	streamReadU16be(file, &dsp.loopFlag,       1);
-	streamReadU16be(file, &dsp.format,         1);
-	streamReadU32be(file, &dsp.loopBeg,        1);
-	streamReadU32be(file, &dsp.loopEnd,        1);
-	streamReadU32be(file, &dsp.curAddress,     1);
-	streamReadI16be(file, dsp.coefs,          16);
-	streamReadU16be(file, &dsp.gain,           1);
-	streamReadU16be(file, &dsp.predScale,      1);
-	streamReadI16be(file, dsp.history,         2);
-	streamReadU16be(file, &dsp.loopPredScale,  1);
-	streamReadI16be(file, dsp.loopHistory,     2);
-	streamReadI16be(file, &dsp.channels,       1);
-	streamReadU16be(file, &dsp.blockSize,      1);
-	streamReadU16be(file, dsp.reserved1,       9);
+	if (!streamReadRecord(file, &dsp, dspHeaderFields, sizeof(dspHeaderFields) / sizeof(StreamField)))
+		goto Fail;
 
 	if (dsp.loopFlag > 1 || dsp.format)
 		goto Fail;
 
-	size_t adpcmSize = getBytesForAdpcmBuffer(dsp.numSamples);
-	adpcm = malloc(adpcmSize);
-	if (!adpcm)
-		goto Fail;
-	out->pcmSize = getBytesForPcmBuffer(dsp.numSamples);
-	out->pcm = malloc(out->pcmSize * sizeof(int16_t));
+	// Float samples take twice the room of the 16-bit samples getBytesForPcmBuffer accounts for
+	out->pcmSize = getBytesForPcmBuffer(dsp.numSamples) * (asFloat ? sizeof(float) / sizeof(int16_t) : 1);
+	out->pcm = malloc(out->pcmSize);
 	if (!out->pcm)
 		goto Fail;
 
-	streamRead(file, adpcm, 1, adpcmSize);
-	streamClose(file);
+	const size_t adpcmSize = getBytesForAdpcmBuffer(dsp.numSamples);
+	const void* src = NULL;
+	const size_t borrowed = streamBorrow(file, &src, adpcmSize);
+	if (borrowed < adpcmSize)
+	{
+		// Stream can't lend its data or is truncated, copy into a zero padded buffer
+		adpcm = calloc(adpcmSize, 1);
+		if (!adpcm)
+			goto Fail;
+		if (borrowed)
+			memcpy(adpcm, src, borrowed);
+		else
+			streamRead(file, adpcm, 1, adpcmSize);
+		src = adpcm;
+	}
 
 	ADPCMINFO adpcmInfo =
 	{
@@ -97,9 +114,13 @@ static int loadDsp(const char* path, PcmFile* out)
 		.loop_yn2 = dsp.loopHistory[1]
 	};
 	memcpy(adpcmInfo.coef, dsp.coefs, sizeof(int16_t) * 16);
-	decode(adpcm, out->pcm, &adpcmInfo, dsp.numSamples);
+	if (asFloat)
+		decodeFloat((uint8_t*)src, (float*)out->pcm, &adpcmInfo, dsp.numSamples);
+	else
+		decode((uint8_t*)src, (int16_t*)out->pcm, &adpcmInfo, dsp.numSamples);
 
 	free(adpcm);
+	streamClose(file);
 
 	out->rate = dsp.sampleRate;
 	return 0;
@@ -113,7 +134,8 @@ Fail:
 
 static void usage(const char* argv0)
 {
-	fprintf(stderr, "Usage: %s <in.dsp> [inR.dsp] [-o out.wav]\n", argv0);
+	fprintf(stderr, "Usage: %s <in.dsp> [inR.dsp] [-f] [-o out.wav]\n", argv0);
+	fprintf(stderr, "  -f  Write 32-bit float samples instead of 16-bit PCM\n");
 	exit(1);
 }
 
@@ -121,7 +143,7 @@ int main(int argc, char* argv[])
 {
 	// Parse cli arguments
 	char* inPathL = NULL, * inPathR = NULL, * outPath = NULL;
-	bool opt = false, outPathAlloc = false;
+	bool opt = false, outPathAlloc = false, asFloat = false;
 	for (int i = 1; i < argc; ++i)
 	{
 		if (opt)
@@ -133,9 +155,12 @@ int main(int argc, char* argv[])
 		}
 		else if (argv[i][0] == '-')
 		{
-			if (argv[i][1] != 'o')
+			if (argv[i][1] == 'f' && !argv[i][2])
+				asFloat = true;
+			else if (argv[i][1] == 'o')
+				opt = true;
+			else
 				usage(argv[0]);
-			opt = true;
 		}
 		else if (!inPathL)
 		{
@@ -180,11 +205,11 @@ int main(int argc, char* argv[])
 	// Convert left (and optionally right) channels to PCM, save as wave
 	int ret;
 	PcmFile left = PCMFILE_CLEAR(), right = PCMFILE_CLEAR();
-	if ((ret = loadDsp(inPathL, &left)))
+	if ((ret = loadDsp(inPathL, &left, asFloat)))
 		goto Cleanup;
 	if (inPathR)
 	{
-		if ((ret = loadDsp(inPathR, &right)))
+		if ((ret = loadDsp(inPathR, &right, asFloat)))
 			goto Cleanup;
 		if (left.pcmSize != right.pcmSize || left.rate != right.rate)
 		{
@@ -195,10 +220,10 @@ int main(int argc, char* argv[])
 
 		WaveSpec wav =
 		{
-			.format    = WAVESPEC_FORMAT_PCM,
+			.format    = asFloat ? WAVESPEC_FORMAT_FLOAT : WAVESPEC_FORMAT_PCM,
 			.channels  = 2,
 			.rate      = left.rate,
-			.bytedepth = sizeof(int16_t)
+			.bytedepth = asFloat ? sizeof(float) : sizeof(int16_t)
 		};
 		if ((ret = waveWriteBlockFile(&wav, (const void*[2]){left.pcm, right.pcm}, left.pcmSize, outPath)))
 			goto Cleanup;
@@ -210,10 +235,10 @@ int main(int argc, char* argv[])
 	{
 		WaveSpec wav =
 		{
-			.format    = WAVESPEC_FORMAT_PCM,
+			.format    = asFloat ? WAVESPEC_FORMAT_FLOAT : WAVESPEC_FORMAT_PCM,
 			.channels  = 1,
 			.rate      = left.rate,
-			.bytedepth = sizeof(int16_t)
+			.bytedepth = asFloat ? sizeof(float) : sizeof(int16_t)
 		};
 		if ((ret = waveWriteFile(&wav, left.pcm, left.pcmSize, outPath)))
 			goto Cleanup;
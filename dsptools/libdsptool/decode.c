@@ -1,19 +1,11 @@
 /* (c) 2017 Alex Barney (MIT) */
 
 #include <stdint.h>
+#include <stddef.h>
 #include "util.h"
+#include "nibble.h"
 #include "dsptool.h"
 
-static inline uint8_t GetHighNibble(uint8_t value)
-{
-	return value >> 4 & 0xF;
-}
-
-static inline uint8_t GetLowNibble(uint8_t value)
-{
-	return value & 0xF;
-}
-
 static inline int16_t Clamp16(int value)
 {
 	if (value > INT16_MAX)
@@ -23,79 +15,80 @@ static inline int16_t Clamp16(int value)
 	return (int16_t)value;
 }
 
-void decode(uint8_t* src, int16_t* dst, ADPCMINFO* cxt, uint32_t samples)
+// Frames expanded to nibbles at a time, so the predictor loop just walks signed nibbles
+#define DECODE_BLOCK_FRAMES 64
+
+// Shared by the decoders & getLoopContext, which passes NULL for both outputs,
+//  hist1/hist2 are updated & the last frame's header is returned
+static FORCE_INLINE uint8_t decodeSamples(const uint8_t* src, int16_t* dst, float* dstFloat, const short* coefs,
+	short* hist1Inout, short* hist2Inout, uint32_t samples)
 {
-	short hist1 = cxt->yn1;
-	short hist2 = cxt->yn2;
-	short* coefs = cxt->coef;
+	int8_t nibbles[DECODE_BLOCK_FRAMES * NIBBLES_PER_FRAME];
+	short hist1 = *hist1Inout;
+	short hist2 = *hist2Inout;
 	uint32_t frameCount = (samples + SAMPLES_PER_FRAME - 1) / SAMPLES_PER_FRAME;
 	uint32_t samplesRemaining = samples;
+	uint8_t ps = 0;
 
-	for (uint32_t i = 0; i < frameCount; i++)
+	for (uint32_t first = 0; first < frameCount; first += DECODE_BLOCK_FRAMES)
 	{
-		int predictor = GetHighNibble(*src);
-		int scale = 1 << GetLowNibble(*src++);
-		short coef1 = coefs[predictor * 2];
-		short coef2 = coefs[predictor * 2 + 1];
-
-		uint32_t samplesToRead = MIN(SAMPLES_PER_FRAME, samplesRemaining);
+		// The last frame may be cut short, so only expand the bytes that hold samples
+		const uint32_t frames = MIN(frameCount - first, DECODE_BLOCK_FRAMES);
+		const uint32_t lastSamples = MIN(SAMPLES_PER_FRAME, samplesRemaining - (frames - 1) * SAMPLES_PER_FRAME);
+		nibbleUnpackSigned(nibbles, src, (frames - 1) * BYTES_PER_FRAME + 1 + (lastSamples + 1) / 2);
+		src += frames * BYTES_PER_FRAME;
 
-		for (uint32_t s = 0; s < samplesToRead; s++)
+		for (uint32_t i = 0; i < frames; i++)
 		{
-			int sample = (s & 0x1)
-				? GetLowNibble(*src++)
-				: GetHighNibble(*src);
-			sample = sample >= 8 ? sample - 16 : sample;
-			sample = (scale * sample) << 11;
-			sample = (sample + 1024 + (coef1 * hist1 + coef2 * hist2)) >> 11;
-			short finalSample = Clamp16(sample);
-
-			hist2 = hist1;
-			hist1 = finalSample;
-
-			*dst++ = finalSample;
+			const int8_t* frame = &nibbles[i * NIBBLES_PER_FRAME];
+			int predictor = frame[0] & 0xF;
+			int scale = 1 << (frame[1] & 0xF);
+			short coef1 = coefs[predictor * 2];
+			short coef2 = coefs[predictor * 2 + 1];
+			ps = (uint8_t)(predictor << 4 | (frame[1] & 0xF));
+
+			uint32_t samplesToRead = MIN(SAMPLES_PER_FRAME, samplesRemaining);
+
+			for (uint32_t s = 0; s < samplesToRead; s++)
+			{
+				int sample = (scale * frame[2 + s]) << 11;
+				sample = (sample + 1024 + (coef1 * hist1 + coef2 * hist2)) >> 11;
+				short finalSample = Clamp16(sample);
+
+				hist2 = hist1;
+				hist1 = finalSample;
+
+				if (dstFloat)
+					*dstFloat++ = finalSample * (1.0f / 32768.0f);
+				else if (dst)
+					*dst++ = finalSample;
+			}
+
+			samplesRemaining -= samplesToRead;
 		}
-
-		samplesRemaining -= samplesToRead;
 	}
+
+	*hist1Inout = hist1;
+	*hist2Inout = hist2;
+	return ps;
 }
 
-void getLoopContext(uint8_t* src, ADPCMINFO* cxt, uint32_t samples)
+void decode(uint8_t* src, int16_t* dst, ADPCMINFO* cxt, uint32_t samples)
 {
-	short hist1 = cxt->yn1;
-	short hist2 = cxt->yn2;
-	short* coefs = cxt->coef;
-	uint8_t ps = 0;
-	int frameCount = (int)((samples + SAMPLES_PER_FRAME - 1) / SAMPLES_PER_FRAME);
-	uint32_t samplesRemaining = samples;
-
-	for (int i = 0; i < frameCount; i++)
-	{
-		ps = *src;
-		int predictor = GetHighNibble(*src);
-		int scale = 1 << GetLowNibble(*src++);
-		short coef1 = coefs[predictor * 2];
-		short coef2 = coefs[predictor * 2 + 1];
-
-		uint32_t samplesToRead = MIN(SAMPLES_PER_FRAME, samplesRemaining);
-
-		for (uint32_t s = 0; s < samplesToRead; s++)
-		{
-			int sample = (s & 0x1)
-				? GetLowNibble(*src++)
-				: GetHighNibble(*src);
-			sample = sample >= 8 ? sample - 16 : sample;
-			sample = (scale * sample) << 11;
-			sample = (sample + 1024 + (coef1 * hist1 + coef2 * hist2)) >> 11;
-			short finalSample = Clamp16(sample);
+	short hist1 = cxt->yn1, hist2 = cxt->yn2;
+	decodeSamples(src, dst, NULL, cxt->coef, &hist1, &hist2, samples);
+}
 
-			hist2 = hist1;
-			hist1 = finalSample;
-		}
-		samplesRemaining -= samplesToRead;
-	}
+void decodeFloat(uint8_t* src, float* dst, ADPCMINFO* cxt, uint32_t samples)
+{
+	short hist1 = cxt->yn1, hist2 = cxt->yn2;
+	decodeSamples(src, NULL, dst, cxt->coef, &hist1, &hist2, samples);
+}
 
-	cxt->loop_pred_scale = ps;
+void getLoopContext(uint8_t* src, ADPCMINFO* cxt, uint32_t samples)
+{
+	short hist1 = cxt->yn1, hist2 = cxt->yn2;
+	cxt->loop_pred_scale = decodeSamples(src, NULL, NULL, cxt->coef, &hist1, &hist2, samples);
 	cxt->loop_yn1 = hist1;
 	cxt->loop_yn2 = hist2;
 }
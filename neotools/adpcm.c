@@ -4,32 +4,37 @@
 
 #include "adpcm.h"
 #include "wave.h"
+#include "verify.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #define BUFFER_SIZE (1024 * 256)
+#define ADPCMA_SAMPLE_RATE 18500
 
 
-int	main(int argc, char* argv[])
+static int decode(const char* inPath, const char* outPath, bool asFloat)
 {
-	fprintf(stderr, "**** ADPCM to PCM converter v 1.01\n\n");
-	if (argc != 3)
-	{
-		fprintf(stderr, "USAGE: adpcm <InputFile.pcm> <OutputFile.wav>\n");
-		return -1;
-	}
-
-	FILE* inFile = fopen(argv[1], "rb");
-	if (!inFile)
+	StreamHandle inFile;
+	if (streamMapOpen(&inFile, inPath) && streamFileOpenBuffered(&inFile, inPath, "rb", STREAM_BUFFER_DEFAULT_SIZE))
 	{
-		fprintf(stderr, "Could not open inputfile %s\n", argv[1]);
+		fprintf(stderr, "Could not open inputfile %s\n", inPath);
 		return -2;
 	}
 
-	StreamHandle outFile;
-	if (streamFileOpen(&outFile, argv[2], "wb"))
+	// Decoded length is unknown up front, so the wave header is back-patched on close
+	const int bytedepth = asFloat ? sizeof(float) : sizeof(short);
+	WaveWriter outFile;
+	if (waveWriterFileOpen(&outFile, &(const WaveSpec)
 	{
-		fprintf(stderr, "Could not open outputfile %s\n", argv[2]);
+		.format    = asFloat ? WAVESPEC_FORMAT_FLOAT : WAVESPEC_FORMAT_PCM,
+		.channels  = 1,
+		.rate      = ADPCMA_SAMPLE_RATE,
+		.bytedepth = bytedepth
+	}, outPath))
+	{
+		fprintf(stderr, "Could not open outputfile %s\n", outPath);
+		streamClose(inFile);
 		return -3;
 	}
 
@@ -40,49 +45,207 @@ int	main(int argc, char* argv[])
 		return -4;
 	}
 
-	short* OutputBuffer = malloc(BUFFER_SIZE * 4);
+	void* OutputBuffer = malloc(BUFFER_SIZE * 2 * bytedepth);
 	if (OutputBuffer == NULL)
 	{
-		fprintf(stderr, "Could not allocate output buffer. (%d bytes)\n", BUFFER_SIZE * 4);
+		fprintf(stderr, "Could not allocate output buffer. (%d bytes)\n", BUFFER_SIZE * 2 * bytedepth);
 		return -5;
 	}
 
 	AdpcmADecoderState decoder;
 	adpcmAInit(&decoder);
+	AdpcmADiagnostics diag = ADPCMA_DIAGNOSTICS_CLEAR();
 
-	fseek(inFile, 0, SEEK_END);
-	unsigned int Filelen = ftell(inFile);
-	fseek(inFile, 0, SEEK_SET);
+	// Convert ADPCM to PCM and write to wave, decoding straight from the input mapping if possible
+	size_t bytesRead;
+	bool failed = false;
+	do
+	{
+		const void* block;
+		if (!(bytesRead = streamBorrow(inFile, &block, BUFFER_SIZE)))
+		{
+			bytesRead = streamRead(inFile, InputBuffer, 1, BUFFER_SIZE);
+			block = InputBuffer;
+		}
+		if (bytesRead > 0)
+		{
+			if (asFloat)
+				adpcmADecodeFloatDiagnose(&decoder, (const char*)block, (float*)OutputBuffer, (int)bytesRead, &diag);
+			else
+				adpcmADecodeDiagnose(&decoder, (const char*)block, (short*)OutputBuffer, (int)bytesRead, &diag);
+			failed = waveWriterAppendFrames(&outFile, OutputBuffer, bytesRead * 2) != 0;
+		}
+	}
+	while (!failed && bytesRead == BUFFER_SIZE);
 
-	// Write wave header
-	waveWrite(&(const WaveSpec)
+	free(OutputBuffer);
+	free(InputBuffer);
+	if (waveWriterClose(&outFile))
+		failed = true;
+	streamClose(inFile);
+	if (failed)
 	{
-		.format    = WAVESPEC_FORMAT_PCM,
-		.channels  = 1,
-		.rate      = 18500,
-		.bytedepth = 2
-	},
-	NULL, Filelen * 4, outFile);
+		fprintf(stderr, "Error writing outputfile %s\n", outPath);
+		return -7;
+	}
+
+	// Saturation usually means the input isn't ADPCM-A or is misaligned
+	if (diag.clipped)
+		fprintf(stderr, "WARNING: %zu of %zu samples clipped, first at sample %zu\n",
+			diag.clipped, diag.samples, diag.firstClip);
+
+	return 0;
+}
+
+static int encode(const char* inPath, const char* outPath)
+{
+	// Input goes through the stream layer, mapped when possible so frames can be borrowed
+	WaveReader reader;
+	if (waveReaderFileOpen(&reader, inPath))
+	{
+		fprintf(stderr, "Could not open inputfile %s or not a wave file\n", inPath);
+		return -2;
+	}
+
+	const WaveSpec* spec = &reader.spec;
+	if (spec->format != WAVESPEC_FORMAT_PCM || spec->channels != 1 || spec->bytedepth != 2)
+	{
+		fprintf(stderr, "Unsupported wave format, only 16-bit mono PCM can be encoded\n");
+		waveReaderClose(&reader);
+		return -6;
+	}
+	if (spec->rate != ADPCMA_SAMPLE_RATE)
+		fprintf(stderr, "WARNING: ADPCM-A plays back at %d Hz, input is %u Hz\n", ADPCMA_SAMPLE_RATE, spec->rate);
+
+	StreamHandle outFile;
+	if (streamFileOpenBuffered(&outFile, outPath, "wb", STREAM_BUFFER_DEFAULT_SIZE))
+	{
+		fprintf(stderr, "Could not open outputfile %s\n", outPath);
+		waveReaderClose(&reader);
+		return -3;
+	}
+
+	int16_t* InputBuffer = malloc(BUFFER_SIZE * 2 * sizeof(int16_t));
+	uint8_t* OutputBuffer = malloc(BUFFER_SIZE);
+	if (InputBuffer == NULL || OutputBuffer == NULL)
+	{
+		fprintf(stderr, "Could not allocate buffers. (%d bytes)\n", BUFFER_SIZE * 5);
+		free(OutputBuffer);
+		free(InputBuffer);
+		streamClose(outFile);
+		waveReaderClose(&reader);
+		return -4;
+	}
 
-	// Convert ADPCM to PCM and write to wave
-	int bytesRead;
+	AdpcmAEncoderState encoder;
+	adpcmAEncoderInit(&encoder);
+
+	// Encode in blocks, the encoder carries an odd trailing nibble across calls
+	size_t read, carry = 0;
 	do
 	{
-		bytesRead = fread(InputBuffer, 1, BUFFER_SIZE, inFile);
-		if (bytesRead > 0)
+		const void* frames;
+		if (!(read = waveReaderBorrowFrames(&reader, &frames, BUFFER_SIZE * 2)))
 		{
-			adpcmADecode(&decoder, InputBuffer, OutputBuffer, bytesRead);
-			streamWrite(outFile, OutputBuffer, bytesRead * 4, 1);
+			read = waveReaderReadFrames(&reader, InputBuffer, BUFFER_SIZE * 2);
+			frames = InputBuffer;
+		}
+		if (read > 0)
+		{
+			adpcmAEncode(&encoder, (const int16_t*)frames, OutputBuffer, (int)read);
+			const size_t packed = (carry + read) / 2;
+			carry = (carry + read) & 0x1;
+			streamWrite(outFile, OutputBuffer, 1, packed);
 		}
 	}
-	while (bytesRead == BUFFER_SIZE);
+	while (read > 0);
+	streamWrite(outFile, OutputBuffer, 1, (size_t)adpcmAEncodeFlush(&encoder, OutputBuffer));
 
+	const bool failed = !streamFlush(outFile) || streamError(outFile);
 	free(OutputBuffer);
 	free(InputBuffer);
 	streamClose(outFile);
-	fclose(inFile);
+	waveReaderClose(&reader);
+	if (failed)
+	{
+		fprintf(stderr, "Error writing outputfile %s\n", outPath);
+		return -7;
+	}
+	return 0;
+}
 
-	fprintf(stderr, "Done...\n");
+// Re-encoding from the decoder state a block started in, the encoder tracks the decoder exactly
+static void verifyDecode(void* restrict state, const uint8_t* restrict in, int16_t* restrict out, int bytes)
+{
+	adpcmADecode((AdpcmADecoderState*)state, (const char*)in, out, bytes);
+}
 
-	return 0;
+static void verifyEncode(const void* restrict user, const void* restrict state,
+	const int16_t* restrict in, uint8_t* restrict out, int samples)
+{
+	(void)user;
+	const AdpcmADecoderState* decoder = (const AdpcmADecoderState*)state;
+	AdpcmAEncoderState encoder;
+	adpcmAEncoderInit(&encoder);
+	encoder.cursignal = decoder->cursignal;
+	encoder.delta = decoder->delta;
+	adpcmAEncode(&encoder, in, out, samples);
+}
+
+static int verify(const char* inPath)
+{
+	AdpcmADecoderState initState;
+	adpcmAInit(&initState);
+	const VerifyCodec codec =
+	{
+		.stateSize = sizeof(AdpcmADecoderState),
+		.initState = &initState,
+		.decode    = verifyDecode,
+		.encode    = verifyEncode,
+		.user      = NULL
+	};
+
+	VerifyResult result;
+	if (verifyFile(&result, &codec, inPath, 0))
+	{
+		fprintf(stderr, "Could not read inputfile %s\n", inPath);
+		return -2;
+	}
+	verifyReport(&result, stderr);
+	const bool exact = result.firstDiff == SIZE_MAX;
+	verifyResultFree(&result);
+	return exact ? 0 : 1;
+}
+
+int	main(int argc, char* argv[])
+{
+	fprintf(stderr, "**** ADPCM to PCM converter v 1.01\n\n");
+
+	// Decoding is the default so the original two argument form keeps working
+	char method = 'd';
+	bool asFloat = false;
+	int argBase = 1;
+	for (; argc - argBase >= 2 && argv[argBase][0] == '-' && argv[argBase][1] && !argv[argBase][2]
+		&& strchr("devf", argv[argBase][1]); ++argBase)
+	{
+		if (argv[argBase][1] == 'f')
+			asFloat = true;
+		else
+			method = argv[argBase][1];
+	}
+	const int numFiles = (method == 'v') ? 1 : 2;
+	if (argc - argBase != numFiles || (asFloat && method != 'd'))
+	{
+		fprintf(stderr, "USAGE: adpcm [-d] [-f] <InputFile.pcm> <OutputFile.wav>  (-f writes 32-bit float)\n");
+		fprintf(stderr, "       adpcm -e <InputFile.wav> <OutputFile.pcm>\n");
+		fprintf(stderr, "       adpcm -v <InputFile.pcm>  (re-encode & compare blockwise)\n");
+		return -1;
+	}
+
+	const int res = (method == 'v') ? verify(argv[argBase])
+		: (method == 'e') ? encode(argv[argBase], argv[argBase + 1])
+		: decode(argv[argBase], argv[argBase + 1], asFloat);
+	if (!res)
+		fprintf(stderr, "Done...\n");
+	return res;
 }
@@ -1,14 +1,49 @@
 #ifndef ADPCM_H
 #define ADPCM_H
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+typedef struct AdpcmAEncoderState
+{
+	bool flag;
+	int cursignal;
+	int delta;
+	uint8_t adpcmPack;
+} AdpcmAEncoderState;
+
+void adpcmAEncoderInit(AdpcmAEncoderState* encoder);
+// Encode len 16-bit samples, two per output byte high nibble first. An odd trailing
+//  nibble is carried into the next call, so (carried + len) / 2 bytes are written.
+void adpcmAEncode(AdpcmAEncoderState* encoder, const int16_t* restrict in, uint8_t* restrict out, int len);
+// Write out a carried nibble padded with a zero low nibble, returns the number of bytes written
+int adpcmAEncodeFlush(AdpcmAEncoderState* encoder, uint8_t* restrict out);
+
 typedef struct AdpcmADecoderState
 {
-	int jediTable[49 * 16];
 	int cursignal;
 	int delta;
 } AdpcmADecoderState;
 
+// Counters for suspect input, accumulated across calls to adpcmADecodeDiagnose
+typedef struct AdpcmADiagnostics
+{
+	size_t samples;    // Samples decoded so far
+	size_t clipped;    // Samples whose prediction left the 12-bit signal range
+	size_t firstClip;  // Sample index of the first clip, only valid if clipped is non-zero
+} AdpcmADiagnostics;
+
+#define ADPCMA_DIAGNOSTICS_CLEAR() { 0, 0, 0 }
+
 void adpcmAInit(AdpcmADecoderState* decoder);
 void adpcmADecode(AdpcmADecoderState* decoder, const char* restrict in, short* restrict out, int len);
+// Decode to normalised [-1, 1) samples, identical to adpcmADecode scaled by 1/32768
+void adpcmADecodeFloat(AdpcmADecoderState* decoder, const char* restrict in, float* restrict out, int len);
+// adpcmADecode that also counts clipping in diag, for reporting once decoding is done
+void adpcmADecodeDiagnose(AdpcmADecoderState* decoder, const char* restrict in, short* restrict out, int len,
+	AdpcmADiagnostics* restrict diag);
+void adpcmADecodeFloatDiagnose(AdpcmADecoderState* decoder, const char* restrict in, float* restrict out, int len,
+	AdpcmADiagnostics* restrict diag);
 
 #endif//ADPCM_H
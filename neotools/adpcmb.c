@@ -3,12 +3,15 @@
 ;
 ;Usage 1: ADPCM_Encode -d [-r:reg,clock] Input.bin Output.wav
 ;Usage 2: ADPCM_Encode -e Input.wav Output.bin
+;Usage 3: ADPCM_Encode -v Input.bin
 ;
 ; Valley Bell
 ;----------------------------------------------------------------------------------------------------------------------------*/
 
 #include "adpcmb.h"
 #include "wave.h"
+#include "threadpool.h"
+#include "verify.h"
 #include "util.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -22,7 +25,7 @@ static FORCE_INLINE uint32_t DeltaTReg2SampleRate(uint16_t DeltaN, uint32_t Cloc
 
 #define BUFFER_SIZE 2048
 
-static int decode(const char* inPath, const char* outPath, uint32_t sampleRate)
+static int decode(const char* inPath, const char* outPath, uint32_t sampleRate, bool asFloat)
 {
 	FILE* inFile = fopen(inPath, "rb");
 	if (inFile == NULL)
@@ -31,15 +34,19 @@ static int decode(const char* inPath, const char* outPath, uint32_t sampleRate)
 		return 2;
 	}
 
-	fseek(inFile, 0, SEEK_END);
-	long adpcmSize = ftell(inFile);
-	fseek(inFile, 0, SEEK_SET);
-
 	uint8_t* adpcmData = malloc(BUFFER_SIZE);
-	int16_t* wavData   = malloc(BUFFER_SIZE * 2 * sizeof(int16_t));
+	const int bytedepth = asFloat ? sizeof(float) : sizeof(int16_t);
+	void*    wavData   = malloc(BUFFER_SIZE * 2 * bytedepth);
 
-	StreamHandle outFile;
-	if (streamFileOpen(&outFile, outPath, "wb"))
+	// Wave header is back-patched once the decoded length is known
+	WaveWriter outFile;
+	if (waveWriterFileOpen(&outFile, &(const WaveSpec)
+	{
+		.format    = asFloat ? WAVESPEC_FORMAT_FLOAT : WAVESPEC_FORMAT_PCM,
+		.channels  = 1,
+		.rate      = sampleRate ? sampleRate : 22050,
+		.bytedepth = bytedepth
+	}, outPath))
 	{
 		printf("Error opening output file!\n");
 		free(wavData);
@@ -48,164 +55,315 @@ static int decode(const char* inPath, const char* outPath, uint32_t sampleRate)
 		return 3;
 	}
 
-	// Write wave header
-	waveWrite(&(const WaveSpec)
-	{
-		.format    = WAVESPEC_FORMAT_PCM,
-		.channels  = 1,
-		.rate      = sampleRate ? sampleRate : 22050,
-		.bytedepth = 2
-	},
-	NULL, (size_t)adpcmSize * 2 * sizeof(int16_t), outFile);
-
 	printf("Decoding ...");
 	AdpcmBDecoderState decoder;
 	adpcmBDecoderInit(&decoder);
 	size_t read;
+	bool failed = false;
 	do
 	{
 		if ((read = fread(adpcmData, 1, BUFFER_SIZE, inFile)) > 0)
 		{
-			adpcmBDecode(&decoder, adpcmData, wavData, read);
-			streamWrite(outFile, wavData, sizeof(int16_t), read * 2);
+			if (asFloat)
+				adpcmBDecodeFloat(&decoder, adpcmData, (float*)wavData, read);
+			else
+				adpcmBDecode(&decoder, adpcmData, (int16_t*)wavData, read);
+			failed = waveWriterAppendFrames(&outFile, wavData, read * 2) != 0;
 		}
 	}
-	while (read == BUFFER_SIZE);
-	printf("  OK\n");
-	streamClose(outFile);
+	while (!failed && read == BUFFER_SIZE);
+	if (waveWriterClose(&outFile))
+		failed = true;
 
 	free(wavData);
 	free(adpcmData);
 	fclose(inFile);
+	if (failed)
+	{
+		printf("  FAILED\nError writing output file!\n");
+		return 3;
+	}
+	printf("  OK\n");
 	printf("File written.\n");
 	return 0;
 }
 
-typedef struct waveformat_tag {
-	uint16_t wFormatTag;        /* format type */
-	uint16_t nChannels;         /* number of channels (i.e. mono, stereo...) */
-	uint32_t nSamplesPerSec;    /* sample rate */
-	uint32_t nAvgBytesPerSec;   /* for buffer estimation */
-	uint16_t nBlockAlign;       /* block size of data */
-	uint16_t wBitsPerSample;
-} WAVEFORMAT;
 
-typedef struct
+// Parallel encoding splits the input into segments encoded speculatively on workers, each
+//  warmed up on the samples before it from a fresh state. Adjacent segments are then stitched
+//  in order by re-encoding from the real state at the boundary until it meets the worker's,
+//  past which both produce the same nibbles. Samples are always passed to adpcmBEncode in
+//  ENCODE_CHUNK sized calls so that trellis frames line up with the serial encoder's.
+#define ENCODE_CHUNK   (BUFFER_SIZE * 2)
+#define SEGMENT_SIZE   (ENCODE_CHUNK * 64)  // Minimum, segments grow so there's about one per thread
+#define WARMUP_SIZE    (ENCODE_CHUNK * 16)
+
+typedef struct EncodeSegment
 {
-	char RIFFfcc[4];
-	uint32_t RIFFLen;
-	char WAVEfcc[4];
-	char fmt_fcc[4];
-	uint32_t fmt_Len;
-	WAVEFORMAT fmt_Data;
-	char datafcc[4];
-	uint32_t dataLen;
-} WAVE_FILE;
-
-static int encode(const char* inPath, const char* outPath)
+	const int16_t* samples;  // Whole input
+	uint8_t* out;            // Whole output, the segment writes from start / 2
+	size_t start, length;    // Range of samples, start is a multiple of ENCODE_CHUNK
+	int trellisWidth;
+	AdpcmBEncoderState* checkpoints;  // Worker state after each chunk, checkpoints[-1] is the warmed up state
+
+} EncodeSegment;
+
+static void encodeSegment(void* user)
 {
-	FILE* hFile = fopen(inPath, "rb");
-	if (hFile == NULL)
-	{
-		printf("Error opening input file!\n");
-		return 2;
-	}
+	EncodeSegment* seg = (EncodeSegment*)user;
+	AdpcmBEncoderState encoder;
+	adpcmBEncoderInitTrellis(&encoder, seg->trellisWidth);
+
+	uint8_t scratch[ENCODE_CHUNK / 2];
+	for (size_t pos = seg->start - MIN(seg->start, WARMUP_SIZE); pos < seg->start; pos += ENCODE_CHUNK)
+		adpcmBEncode(&encoder, &seg->samples[pos], scratch, ENCODE_CHUNK);
+	seg->checkpoints[-1] = encoder;
 
-	WAVE_FILE WaveFile;
-	fread(&WaveFile.RIFFfcc, 0x0C, 0x01, hFile);
-	if (memcmp(WaveFile.RIFFfcc, "RIFF", 4) != 0 || memcmp(WaveFile.WAVEfcc, "WAVE", 4) != 0)
+	const size_t end = seg->start + seg->length;
+	for (size_t pos = seg->start, i = 0; pos < end; pos += ENCODE_CHUNK, ++i)
 	{
-		fclose(hFile);
-		printf("This is no wave file!\n");
-		return 4;
+		adpcmBEncode(&encoder, &seg->samples[pos], &seg->out[pos / 2], (int)MIN(end - pos, ENCODE_CHUNK));
+		seg->checkpoints[i] = encoder;
 	}
+}
+
+typedef struct HandoffStats
+{
+	size_t boundaries;
+	size_t reencoded, maxReencoded;  // Samples encoded again before meeting the worker's state
+	size_t unmatched;                // Boundaries that never met it, so the whole segment was encoded serially
 
-	unsigned int TempLng = fread(&WaveFile.fmt_fcc, 0x04, 0x01, hFile);
-	fread(&WaveFile.fmt_Len, 0x04, 0x01, hFile);
-	while (memcmp(WaveFile.fmt_fcc, "fmt ", 4) != 0)
+} HandoffStats;
+
+// Stitch seg onto the encoding before it, which ended in state, & return the state it ends in.
+//  Splicing the worker's nibbles onto a state they weren't encoded from would leave the decoder
+//  off by a constant that ADPCM-B never recovers from, so we only ever switch over on an exact match.
+static AdpcmBEncoderState encodeHandoff(const EncodeSegment* restrict seg, AdpcmBEncoderState state,
+	HandoffStats* restrict stats)
+{
+	const size_t chunks = (seg->length + ENCODE_CHUNK - 1) / ENCODE_CHUNK;
+	const size_t end = seg->start + seg->length;
+	++stats->boundaries;
+	for (size_t i = 0; i < chunks; ++i)
 	{
-		if (!TempLng) // TempLng == 0 -> EOF reached
+		// The encoder is deterministic, so once the states meet the worker's nibbles are what we'd write
+		const AdpcmBEncoderState* worker = &seg->checkpoints[(ptrdiff_t)i - 1];
+		if (state.xn == worker->xn && state.stepSize == worker->stepSize)
 		{
-			fclose(hFile);
-			printf("Error in wave file: Can't find format-tag!\n");
-			return 4;
+			stats->reencoded += i * ENCODE_CHUNK;
+			stats->maxReencoded = MAX(stats->maxReencoded, i * ENCODE_CHUNK);
+			return seg->checkpoints[chunks - 1];
 		}
-		fseek(hFile, WaveFile.fmt_Len, SEEK_CUR);
 
-		TempLng = fread(&WaveFile.fmt_fcc, 0x04, 0x01, hFile);
-		fread(&WaveFile.fmt_Len, 0x04, 0x01, hFile);
-	};
-	TempLng = ftell(hFile) + WaveFile.fmt_Len;
-	fread(&WaveFile.fmt_Data, sizeof(WAVEFORMAT), 0x01, hFile);
-	fseek(hFile, TempLng, SEEK_SET);
+		const size_t pos = seg->start + i * ENCODE_CHUNK;
+		adpcmBEncode(&state, &seg->samples[pos], &seg->out[pos / 2], (int)MIN(end - pos, ENCODE_CHUNK));
+	}
 
-	WAVEFORMAT* TempFmt = &WaveFile.fmt_Data;
-	if (TempFmt->wFormatTag != WAVESPEC_FORMAT_PCM)
+	++stats->unmatched;
+	stats->reencoded += seg->length;
+	stats->maxReencoded = MAX(stats->maxReencoded, seg->length);
+	return state;
+}
+
+static int encodeParallel(WaveReader* restrict reader, FILE* restrict outFile, int trellisWidth, int numThreads)
+{
+	// Every boundary costs a stretch of serial re-encoding, so use as few segments as keeps each thread busy
+	const size_t numSamples = (size_t)(reader->dataRemaining / sizeof(int16_t));
+	size_t segmentSize = (numSamples + (size_t)numThreads - 1) / (size_t)numThreads;
+	segmentSize = MAX((segmentSize + ENCODE_CHUNK - 1) / ENCODE_CHUNK * ENCODE_CHUNK, SEGMENT_SIZE);
+	const size_t numSegments = (numSamples + segmentSize - 1) / segmentSize;
+	const size_t numChunks = (numSamples + ENCODE_CHUNK - 1) / ENCODE_CHUNK;
+
+	int16_t* samples = malloc(numSamples * sizeof(int16_t));
+	uint8_t* adpcmData = malloc(numSamples / 2 + 1);
+	EncodeSegment* segments = malloc(numSegments * sizeof(EncodeSegment));
+	AdpcmBEncoderState* checkpoints = malloc((numChunks + numSegments) * sizeof(AdpcmBEncoderState));
+	ThreadPool* pool = NULL;
+	int err = 0;
+	if (!samples || !adpcmData || !segments || !checkpoints || threadPoolCreate(&pool, numThreads, (int)numSegments))
 	{
-		fclose(hFile);
-		printf("Error in wave file: Compressed wave file are not supported!\n");
-		return 4;
+		printf("Error allocating encoder!\n");
+		err = 5;
+		goto cleanup;
 	}
-	if (TempFmt->nChannels != 1)
+	if (waveReaderReadFrames(reader, samples, numSamples) != numSamples)
 	{
-		fclose(hFile);
-		printf("Error in wave file: Unsupported number of channels (%hu)!\n", TempFmt->nChannels);
-		return 4;
+		printf("Error reading input file!\n");
+		err = 2;
+		goto cleanup;
 	}
-	if (TempFmt->wBitsPerSample != 16)
+
+	printf("Encoding ...");
+	AdpcmBEncoderState* checkpoint = checkpoints;
+	for (size_t i = 0; i < numSegments; ++i)
 	{
-		fclose(hFile);
-		printf("Error in wave file: Only 16-bit waves are supported! (File uses %hu bit)\n", TempFmt->wBitsPerSample);
-		return 4;
+		const size_t start = i * segmentSize, length = MIN(numSamples - start, segmentSize);
+		segments[i] = (EncodeSegment)
+		{
+			.samples      = samples,
+			.out          = adpcmData,
+			.start        = start,
+			.length       = length,
+			.trellisWidth = trellisWidth,
+			.checkpoints  = checkpoint + 1
+		};
+		checkpoint += 1 + (length + ENCODE_CHUNK - 1) / ENCODE_CHUNK;
+		threadPoolSubmit(pool, encodeSegment, &segments[i]);
 	}
+	threadPoolWait(pool);
+
+	// The first segment starts from a fresh encoder just like the serial one, the rest are stitched on in order
+	HandoffStats stats = { 0, 0, 0, 0 };
+	AdpcmBEncoderState state = segments[0].checkpoints[(segments[0].length + ENCODE_CHUNK - 1) / ENCODE_CHUNK - 1];
+	for (size_t i = 1; i < numSegments; ++i)
+		state = encodeHandoff(&segments[i], state, &stats);
+	printf("  OK\n");
+
+	// Output is identical to serial encoding either way, this is what the boundaries cost to get there
+	if (stats.boundaries)
+		printf("%zu segment boundaries re-encoded %zu samples serially (at most %zu), %zu never matched\n",
+			stats.boundaries, stats.reencoded, stats.maxReencoded, stats.unmatched);
 
-	TempLng = fread(&WaveFile.datafcc, 0x04, 0x01, hFile);
-	fread(&WaveFile.dataLen, 0x04, 0x01, hFile);
-	while (memcmp(WaveFile.datafcc, "data", 4) != 0)
+	// An odd trailing nibble is dropped, same as when encoding serially
+	if (fwrite(adpcmData, 1, numSamples / 2, outFile) != numSamples / 2)
 	{
-		if (!TempLng) // TempLng == 0 -> EOF reached
-		{
-			fclose(hFile);
-			printf("Error in wave file: Can't find data-tag!\n");
-			return 4;
-		}
-		fseek(hFile, WaveFile.dataLen, SEEK_CUR);
+		printf("Error writing output file!\n");
+		err = 3;
+	}
 
-		TempLng = fread(&WaveFile.datafcc, 0x04, 0x01, hFile);
-		fread(&WaveFile.dataLen, 0x04, 0x01, hFile);
-	};
-	unsigned int WaveSize = WaveFile.dataLen / 2;
-	int16_t* WaveData = malloc(WaveSize * 2);
-	fread(WaveData, 0x02, WaveSize, hFile);
+cleanup:
+	if (pool)
+		threadPoolDestroy(pool);
+	free(checkpoints);
+	free(segments);
+	free(adpcmData);
+	free(samples);
+	return err;
+}
 
-	fclose(hFile);
+static int encode(const char* inPath, const char* outPath, int trellisWidth, int numThreads)
+{
+	WaveReader reader;
+	if (waveReaderFileOpen(&reader, inPath))
+	{
+		printf("Error opening input file or not a wave file!\n");
+		return 2;
+	}
 
-	unsigned int AdpcmSize = WaveSize / 2;
-	uint8_t* AdpcmData = malloc(AdpcmSize);
-	printf("Encoding ...");
-	AdpcmBEncoderState encoder;
-	adpcmBEncoderInit(&encoder);
-	adpcmBEncode(&encoder, WaveData, AdpcmData, WaveSize);
-	printf("  OK\n");
+	const WaveSpec* spec = &reader.spec;
+	int err = 0;
+	if (spec->format != WAVESPEC_FORMAT_PCM)
+	{
+		printf("Error in wave file: Compressed wave file are not supported!\n");
+		err = 4;
+	}
+	else if (spec->channels != 1)
+	{
+		printf("Error in wave file: Unsupported number of channels (%d)!\n", spec->channels);
+		err = 4;
+	}
+	else if (spec->bytedepth != 2)
+	{
+		printf("Error in wave file: Only 16-bit waves are supported! (File uses %d bit)\n", spec->bytedepth * 8);
+		err = 4;
+	}
+	if (err)
+	{
+		waveReaderClose(&reader);
+		return err;
+	}
 
-	hFile = fopen(outPath, "wb");
+	FILE* hFile = fopen(outPath, "wb");
 	if (hFile == NULL)
 	{
 		printf("Error opening output file!\n");
-		free(AdpcmData);
-		free(WaveData);
+		waveReaderClose(&reader);
 		return 3;
 	}
 
-	fwrite(AdpcmData, 0x01, AdpcmSize, hFile);
+	if (!numThreads)
+		numThreads = threadPoolDefaultThreads();
+	if (numThreads > 1 && reader.dataRemaining > SEGMENT_SIZE * sizeof(int16_t))
+	{
+		err = encodeParallel(&reader, hFile, trellisWidth, numThreads);
+		fclose(hFile);
+		if (!err)
+			printf("File written.\n");
+		waveReaderClose(&reader);
+		return err;
+	}
+
+	// Encode in fixed size blocks, the encoder carries an odd trailing nibble across calls
+	int16_t* waveData  = malloc(BUFFER_SIZE * 2 * sizeof(int16_t));
+	uint8_t* adpcmData = malloc(BUFFER_SIZE);
+	printf("Encoding ...");
+	AdpcmBEncoderState encoder;
+	adpcmBEncoderInitTrellis(&encoder, trellisWidth);
+	size_t read, carry = 0;
+	while ((read = waveReaderReadFrames(&reader, waveData, BUFFER_SIZE * 2)) > 0)
+	{
+		adpcmBEncode(&encoder, waveData, adpcmData, (int)read);
+		const size_t packed = (carry + read) / 2;
+		carry = (carry + read) & 0x1;
+		fwrite(adpcmData, 0x01, packed, hFile);
+	}
+	printf("  OK\n");
+
 	fclose(hFile);
 	printf("File written.\n");
 
-	free(AdpcmData);
-	free(WaveData);
+	free(adpcmData);
+	free(waveData);
+	waveReaderClose(&reader);
 	return 0;
 }
 
+// Verification re-encodes each block from the decoder state it started in, the encoder
+//  tracks the same xn & step size so it picks up exactly where the original one left off
+static void verifyDecode(void* restrict state, const uint8_t* restrict in, int16_t* restrict out, int bytes)
+{
+	adpcmBDecode((AdpcmBDecoderState*)state, in, out, bytes);
+}
+
+static void verifyEncode(const void* restrict user, const void* restrict state,
+	const int16_t* restrict in, uint8_t* restrict out, int samples)
+{
+	const AdpcmBDecoderState* decoder = (const AdpcmBDecoderState*)state;
+	AdpcmBEncoderState encoder;
+	adpcmBEncoderInitTrellis(&encoder, *(const int*)user);
+	encoder.xn = decoder->xn;
+	encoder.stepSize = decoder->stepSize;
+	for (int pos = 0; pos < samples; pos += ENCODE_CHUNK)
+		adpcmBEncode(&encoder, &in[pos], &out[pos / 2], MIN(samples - pos, ENCODE_CHUNK));
+}
+
+static int verify(const char* inPath, int trellisWidth, int numThreads)
+{
+	AdpcmBDecoderState initState;
+	adpcmBDecoderInit(&initState);
+	const VerifyCodec codec =
+	{
+		.stateSize = sizeof(AdpcmBDecoderState),
+		.initState = &initState,
+		.decode    = verifyDecode,
+		.encode    = verifyEncode,
+		.user      = &trellisWidth
+	};
+
+	printf("Verifying ...");
+	VerifyResult result;
+	if (verifyFile(&result, &codec, inPath, numThreads))
+	{
+		printf("\nError reading input file!\n");
+		return 2;
+	}
+	printf("  OK\n");
+
+	verifyReport(&result, stdout);
+	const bool exact = result.firstDiff == SIZE_MAX;
+	verifyResultFree(&result);
+	return exact ? 0 : 6;
+}
 
 int main(int argc, char* argv[])
 {
@@ -214,40 +372,64 @@ int main(int argc, char* argv[])
 	char* TempPnt;
 
 	printf("NeoGeo ADPCM-B En-/Decoder\n--------------------------\n");
-	if (argc < 4)
+	if (argc < 3)
 	{
 		printf("Usage: ADPCM_Encode -method [-option] InputFile OutputFile\n");
+		printf("       ADPCM_Encode -v [-option] InputFile\n");
 		printf("-method - En-/Decoding Method:\n");
 		printf("    -d for decode (bin -> wav)\n");
 		printf("    -e for encode (wav -> bin)\n");
-		printf("-option - Options for Sample Rate of decoded Wave:\n");
+		printf("    -v for verify (decode, re-encode & compare bin blockwise)\n");
+		printf("-option - Options for decoded Wave:\n");
 		printf("    -s:rate - Sample Rate in Hz (default: 22050)\n");
+		printf("    -f - Write 32-bit float samples instead of 16-bit PCM\n");
 		printf("    -r:regs[,clock] - DeltaT Register value (use 0x for hex) and chip clock\n");
 		printf("                      (default chip clock: 4 MHz)\n");
+		printf("-option - Options for Encoding:\n");
+		printf("    -t:width - Trellis search width, higher is slower but more accurate\n");
+		printf("               (default: 1, max: %d)\n", ADPCMB_TRELLIS_MAX_WIDTH);
+		printf("    -j:threads - Encode segments in parallel, 0 uses all hardware threads\n");
+		printf("                 (default: 1, segments are stitched to match serial encoding)\n");
+		printf("                 (verify defaults to all hardware threads)\n");
 		printf("\n");
-		printf("Wave In-/Output is 16-bit, Mono\n");
+		printf("Wave Input is 16-bit, Mono. Output is 16-bit (or float with -f), Mono\n");
 		return 1;
 	}
 
-	if (strcmp(argv[1], "-d") && strcmp(argv[1], "-e"))
+	if (strcmp(argv[1], "-d") && strcmp(argv[1], "-e") && strcmp(argv[1], "-v"))
 	{
-		printf("Wrong option! Use -d or -e!\n");
+		printf("Wrong option! Use -d, -e or -v!\n");
 		return 1;
 	}
+	const int NumFiles = (argv[1][1] == 'v') ? 1 : 2;
 
 	int ErrVal = 0;
 	uint32_t OutSmplRate = 0;
 
+	int TrellisWidth = 1;
+	int NumThreads = -1;
+	bool FloatOut = false;
+
 	int ArgBase = 2;
-	if (argv[2][0] == '-' && argv[2][2] == ':')
+	while (ArgBase < argc && argv[ArgBase][0] == '-' && argv[ArgBase][1]
+		&& (argv[ArgBase][2] == ':' || !strcmp(argv[ArgBase], "-f")))
 	{
-		switch (argv[2][1])
+		switch (argv[ArgBase][1])
 		{
+		case 'f':
+			FloatOut = true;
+			break;
 		case 's':
-			OutSmplRate = strtol(argv[2] + 3, NULL, 0);
+			OutSmplRate = strtol(argv[ArgBase] + 3, NULL, 0);
+			break;
+		case 't':
+			TrellisWidth = (int)strtol(argv[ArgBase] + 3, NULL, 0);
+			break;
+		case 'j':
+			NumThreads = (int)strtol(argv[ArgBase] + 3, NULL, 0);
 			break;
 		case 'r':
-			DTRegs = (uint16_t)strtoul(argv[2] + 3, &TempPnt, 0);
+			DTRegs = (uint16_t)strtoul(argv[ArgBase] + 3, &TempPnt, 0);
 			TempLng = 0;
 			if (*TempPnt == ',')
 			{
@@ -258,20 +440,24 @@ int main(int argc, char* argv[])
 			OutSmplRate = DeltaTReg2SampleRate(DTRegs, TempLng);
 			break;
 		}
-		if (argc < ++ArgBase + 2)
-		{
-			printf("Not enought arguments!\n");
-			return 1;
-		}
+		++ArgBase;
+	}
+	if (argc < ArgBase + NumFiles)
+	{
+		printf("Not enought arguments!\n");
+		return 1;
 	}
 
 	switch (argv[1][1])
 	{
 	case 'd':
-		ErrVal = decode(argv[ArgBase + 0], argv[ArgBase + 1], OutSmplRate);
+		ErrVal = decode(argv[ArgBase + 0], argv[ArgBase + 1], OutSmplRate, FloatOut);
 		break;
 	case 'e':
-		ErrVal = encode(argv[ArgBase + 0], argv[ArgBase + 1]);
+		ErrVal = encode(argv[ArgBase + 0], argv[ArgBase + 1], TrellisWidth, (NumThreads < 0) ? 1 : NumThreads);
+		break;
+	case 'v':
+		ErrVal = verify(argv[ArgBase + 0], TrellisWidth, (NumThreads < 0) ? 0 : NumThreads);
 		break;
 	}
 
@@ -4,14 +4,20 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#define ADPCMB_TRELLIS_MAX_WIDTH 32
+
 typedef struct AdpcmBEncoderState
 {
 	bool flag;
 	long xn, stepSize;
 	uint8_t adpcmPack;
+	int trellisWidth;  // Paths kept by the trellis search, 1 is the greedy quantiser
 } AdpcmBEncoderState;
 
 void adpcmBEncoderInit(AdpcmBEncoderState* encoder);
+// Search up to width nibble sequences at once for the one with the least squared error,
+//  width is clamped to [1, ADPCMB_TRELLIS_MAX_WIDTH] & 1 gives the same output as adpcmBEncoderInit
+void adpcmBEncoderInitTrellis(AdpcmBEncoderState* encoder, int width);
 void adpcmBEncode(AdpcmBEncoderState* encoder, const int16_t* restrict in, uint8_t* restrict out, int len);
 
 typedef struct AdpcmBDecoderState
@@ -21,5 +27,6 @@ typedef struct AdpcmBDecoderState
 
 void adpcmBDecoderInit(AdpcmBDecoderState* decoder);
 void adpcmBDecode(AdpcmBDecoderState* decoder, const uint8_t* restrict in, int16_t* restrict out, int len);
+void adpcmBDecodeFloat(AdpcmBDecoderState* decoder, const uint8_t* restrict in, float* restrict out, int len);
 
 #endif//ADPCMB_H
@@ -0,0 +1,273 @@
+/* dedup.c (c) 2025 a dinosaur (zlib) */
+
+#include "dedup.h"
+#include "endian.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <assert.h>
+
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87ULL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define XXH_PRIME64_3 0x165667B19E3779F9ULL
+#define XXH_PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5ULL
+
+static FORCE_INLINE uint64_t rotl64(uint64_t x, unsigned r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static FORCE_INLINE uint64_t readU64le(const uint8_t* p)
+{
+	uint64_t v;
+	memcpy(&v, p, sizeof(uint64_t));
+	return SWAP_LE64(v);
+}
+
+static FORCE_INLINE uint32_t readU32le(const uint8_t* p)
+{
+	uint32_t v;
+	memcpy(&v, p, sizeof(uint32_t));
+	return SWAP_LE32(v);
+}
+
+static FORCE_INLINE uint64_t xxhRound(uint64_t acc, uint64_t input)
+{
+	return rotl64(acc + input * XXH_PRIME64_2, 31) * XXH_PRIME64_1;
+}
+
+static FORCE_INLINE uint64_t xxhMergeRound(uint64_t acc, uint64_t value)
+{
+	return (acc ^ xxhRound(0, value)) * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+uint64_t dedupHash64(const void* restrict data, size_t size, uint64_t seed)
+{
+	const uint8_t* p = (const uint8_t*)data;
+	const uint8_t* const end = p + size;
+	uint64_t h;
+
+	// Four independent lanes over 32 byte stripes
+	if (size >= 32)
+	{
+		uint64_t v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2, v2 = seed + XXH_PRIME64_2;
+		uint64_t v3 = seed, v4 = seed - XXH_PRIME64_1;
+		for (; p + 32 <= end; p += 32)
+		{
+			v1 = xxhRound(v1, readU64le(&p[0]));
+			v2 = xxhRound(v2, readU64le(&p[8]));
+			v3 = xxhRound(v3, readU64le(&p[16]));
+			v4 = xxhRound(v4, readU64le(&p[24]));
+		}
+		h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+		h = xxhMergeRound(h, v1);
+		h = xxhMergeRound(h, v2);
+		h = xxhMergeRound(h, v3);
+		h = xxhMergeRound(h, v4);
+	}
+	else
+	{
+		h = seed + XXH_PRIME64_5;
+	}
+	h += (uint64_t)size;
+
+	// Tail
+	for (; p + 8 <= end; p += 8)
+		h = rotl64(h ^ xxhRound(0, readU64le(p)), 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	if (p + 4 <= end)
+	{
+		h = rotl64(h ^ (uint64_t)readU32le(p) * XXH_PRIME64_1, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+	}
+	for (; p < end; ++p)
+		h = rotl64(h ^ (uint64_t)*p * XXH_PRIME64_5, 11) * XXH_PRIME64_1;
+
+	// Avalanche
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+
+static bool dedupIndexReserve(DedupIndex* restrict index, size_t count)
+{
+	// Keep the load factor under 3/4
+	if (count * 4 < index->capacity * 3)
+		return true;
+
+	size_t newCapacity = index->capacity ? index->capacity * 2 : 256;
+	DedupEntry* newEntries = calloc(newCapacity, sizeof(DedupEntry));
+	if (!newEntries)
+		return false;
+	for (size_t i = 0; i < index->capacity; ++i)
+	{
+		const DedupEntry* entry = &index->entries[i];
+		if (!entry->type)
+			continue;
+		size_t slot = (size_t)entry->hash & (newCapacity - 1);
+		while (newEntries[slot].type)
+			slot = (slot + 1) & (newCapacity - 1);
+		newEntries[slot] = *entry;
+	}
+	free(index->entries);
+	index->entries = newEntries;
+	index->capacity = newCapacity;
+	return true;
+}
+
+static DedupEntry* dedupIndexInsert(DedupIndex* restrict index, uint64_t hash, char type, uint32_t size,
+	const char* restrict name)
+{
+	if (!dedupIndexReserve(index, index->count + 1))
+		return NULL;
+	size_t slot = (size_t)hash & (index->capacity - 1);
+	while (index->entries[slot].type)
+		slot = (slot + 1) & (index->capacity - 1);
+
+	DedupEntry* entry = &index->entries[slot];
+	(*entry) = (DedupEntry)
+	{
+		.hash = hash,
+		.size = size,
+		.type = type,
+		.data = NULL
+	};
+	snprintf(entry->name, DEDUP_NAME_MAX, "%s", name);
+	++index->count;
+	return entry;
+}
+
+int dedupIndexOpen(DedupIndex* restrict index, const char* restrict path)
+{
+	assert(index && path);
+	(*index) = (DedupIndex)
+	{
+		.entries  = NULL,
+		.count    = 0,
+		.capacity = 0,
+		.manifest = NULL
+	};
+
+	// Lines are "hash type size name block source", the first line for a hash names the decoded file
+	FILE* file = fopen(path, "r");
+	if (file)
+	{
+		char line[1024];
+		while (fgets(line, sizeof(line), file))
+		{
+			uint64_t hash;
+			char type;
+			unsigned size;
+			char name[DEDUP_NAME_MAX];
+			if (line[0] == '#' || sscanf(line, "%" SCNx64 " %c %u %39s", &hash, &type, &size, name) != 4)
+				continue;
+			if (!dedupIndexFind(index, hash, type, NULL, size) && !dedupIndexInsert(index, hash, type, size, name))
+			{
+				fclose(file);
+				dedupIndexClose(index);
+				return ENOMEM;
+			}
+		}
+		fclose(file);
+	}
+
+	if (!(index->manifest = fopen(path, "a")))
+	{
+		const int err = errno;
+		errno = 0;
+		dedupIndexClose(index);
+		return err;
+	}
+	return 0;
+}
+
+void dedupIndexClose(DedupIndex* restrict index)
+{
+	if (index->manifest)
+		fclose(index->manifest);
+	free(index->entries);
+	index->entries = NULL;
+	index->manifest = NULL;
+	index->count = index->capacity = 0;
+}
+
+const DedupEntry* dedupIndexFind(const DedupIndex* restrict index, uint64_t hash, char type,
+	const void* restrict data, size_t size)
+{
+	if (!index->capacity)
+		return NULL;
+	for (size_t slot = (size_t)hash & (index->capacity - 1); index->entries[slot].type;
+		slot = (slot + 1) & (index->capacity - 1))
+	{
+		const DedupEntry* entry = &index->entries[slot];
+		if (entry->hash != hash || entry->type != type || entry->size != size)
+			continue;
+		// Only blocks seen in this run can be checked for a hash collision
+		if (data && entry->data && memcmp(data, entry->data, size))
+			continue;
+		return entry;
+	}
+	return NULL;
+}
+
+int dedupIndexAdd(DedupIndex* restrict index, uint64_t hash, char type, const void* restrict data, size_t size,
+	const char* restrict name)
+{
+	assert(size <= UINT32_MAX);
+	DedupEntry* entry = dedupIndexInsert(index, hash, type, (uint32_t)size, name);
+	if (!entry)
+		return ENOMEM;
+	entry->data = data;
+	return 0;
+}
+
+void dedupIndexRemove(DedupIndex* restrict index, const DedupEntry* restrict entry)
+{
+	if (!index->capacity)
+		return;
+	const size_t mask = index->capacity - 1;
+	size_t hole = (size_t)entry->hash & mask;
+	for (; index->entries[hole].type; hole = (hole + 1) & mask)
+	{
+		const DedupEntry* other = &index->entries[hole];
+		if (other->hash == entry->hash && other->type == entry->type && other->size == entry->size
+			&& !strcmp(other->name, entry->name))
+			break;
+	}
+	if (!index->entries[hole].type)
+		return;
+
+	// Pull back later entries of the probe run that the hole would otherwise hide from lookups
+	for (size_t slot = (hole + 1) & mask; index->entries[slot].type; slot = (slot + 1) & mask)
+	{
+		const size_t home = (size_t)index->entries[slot].hash & mask;
+		if (((slot - home) & mask) >= ((slot - hole) & mask))
+		{
+			index->entries[hole] = index->entries[slot];
+			hole = slot;
+		}
+	}
+	index->entries[hole].type = 0;
+	--index->count;
+}
+
+void dedupIndexReleaseData(DedupIndex* restrict index)
+{
+	for (size_t i = 0; i < index->capacity; ++i)
+		index->entries[i].data = NULL;
+}
+
+void dedupIndexRecord(DedupIndex* restrict index, const DedupEntry* restrict entry,
+	const char* restrict source, unsigned blockId)
+{
+	if (index->manifest)
+		fprintf(index->manifest, "%016" PRIx64 " %c %" PRIu32 " %s %u %s\n",
+			entry->hash, entry->type, entry->size, entry->name, blockId, source);
+}
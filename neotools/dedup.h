@@ -0,0 +1,50 @@
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define DEDUP_NAME_MAX 40
+
+// 64-bit XXH64 hash of a raw block
+uint64_t dedupHash64(const void* restrict data, size_t size, uint64_t seed);
+
+typedef struct DedupEntry
+{
+	uint64_t hash;
+	uint32_t size;
+	char type;                    // 'A' or 'B'
+	char name[DEDUP_NAME_MAX];    // File the block was decoded to
+	const void* data;             // Raw block for collision checks, NULL if it came from the manifest
+
+} DedupEntry;
+
+typedef struct DedupIndex
+{
+	DedupEntry* entries;  // Open addressed on hash, empty slots have a zero type
+	size_t count, capacity;
+	FILE* manifest;       // Opened for appending by dedupIndexOpen
+
+} DedupIndex;
+
+// Load the manifest at path if it exists & open it for appending new records
+int dedupIndexOpen(DedupIndex* restrict index, const char* restrict path);
+void dedupIndexClose(DedupIndex* restrict index);
+
+// Find a previously seen block, when data is non-NULL blocks from this run are compared byte for byte
+const DedupEntry* dedupIndexFind(const DedupIndex* restrict index, uint64_t hash, char type,
+	const void* restrict data, size_t size);
+// Record a block that was decoded to name, data must stay valid while dedupIndexFind may compare against it
+int dedupIndexAdd(DedupIndex* restrict index, uint64_t hash, char type, const void* restrict data, size_t size,
+	const char* restrict name);
+// Drop an entry added with dedupIndexAdd whose file never got written, so nothing else is skipped in its favour
+void dedupIndexRemove(DedupIndex* restrict index, const DedupEntry* restrict entry);
+// Forget the raw data of blocks added so far, for when it's about to be freed
+void dedupIndexReleaseData(DedupIndex* restrict index);
+// Append a manifest record mapping block number blockId of source to the file holding its decoded data
+void dedupIndexRecord(DedupIndex* restrict index, const DedupEntry* restrict entry,
+	const char* restrict source, unsigned blockId);
+
+#endif//DEDUP_H
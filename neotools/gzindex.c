@@ -0,0 +1,514 @@
+/* gzindex.c (c) 2025 a dinosaur (zlib) */
+
+#include "gzindex.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <assert.h>
+
+#if USE_ZLIB
+# define ZLIB_CONST
+# include <zlib.h>
+
+#define GZINDEX_MAGIC     "NGZI"
+#define GZINDEX_VERSION   1
+#define GZINDEX_TRAILER   8        // CRC-32 & length of the uncompressed data, which identify the file
+#define GZINDEX_READ_SIZE 0x10000  // Uncompressed bytes inflated at a time by readers
+#define GZINDEX_READ_KEEP 0x1000   // Of which kept across refills so short backward seeks stay cheap
+
+
+int gzIndexOpen(GzIndex* restrict index, StreamHandle source)
+{
+	assert(index);
+	(*index) = (GzIndex)
+	{
+		.source   = source,
+		.data     = NULL,
+		.size     = 0,
+		.length   = 0,
+		.span     = 0,
+		.points   = NULL,
+		.count    = 0,
+		.reserved = 0
+	};
+
+	// Anything left over after borrowing means the stream can only lend part of itself
+	const void* data = NULL;
+	if (!streamSeek(source, 0, STREAM_SEEK_SET) || !(index->size = streamBorrow(source, &data, SIZE_MAX))
+		|| streamGetC(source) >= 0)
+	{
+		streamClose(source);
+		index->source.cb = NULL;
+		return EINVAL;
+	}
+	index->data = (const uint8_t*)data;
+	return 0;
+}
+
+static void gzIndexFreePoints(GzIndex* restrict index)
+{
+	for (size_t i = 0; i < index->count; ++i)
+		free(index->points[i].window);
+	free(index->points);
+	index->points = NULL;
+	index->count = index->reserved = 0;
+}
+
+void gzIndexClose(GzIndex* restrict index)
+{
+	gzIndexFreePoints(index);
+	if (index->source.cb)
+		streamClose(index->source);
+	index->source.cb = NULL;
+	index->data = NULL;
+}
+
+static GzIndexPoint* gzIndexAddPoint(GzIndex* restrict index, uint32_t windowSize)
+{
+	if (index->count == index->reserved)
+	{
+		const size_t reserve = index->reserved ? index->reserved * 2 : 16;
+		GzIndexPoint* points = realloc(index->points, sizeof(GzIndexPoint) * reserve);
+		if (!points)
+			return NULL;
+		index->points = points;
+		index->reserved = reserve;
+	}
+	GzIndexPoint* point = &index->points[index->count];
+	if (!(point->window = malloc(MAX(windowSize, 1))))
+		return NULL;
+	point->windowSize = windowSize;
+	++index->count;
+	return point;
+}
+
+int gzIndexBuild(GzIndex* restrict index, size_t span)
+{
+	assert(index && index->data && span);
+	gzIndexFreePoints(index);
+
+	z_stream strm;
+	memset(&strm, 0, sizeof(z_stream));
+	uint8_t* window = malloc(GZINDEX_WINDOW_SIZE);
+	if (!window || inflateInit2(&strm, 15 + 16) != Z_OK)  // Gzip wrapper only
+	{
+		free(window);
+		return ENOMEM;
+	}
+
+	// Inflate into a ring of the last 32K of output so there's always history at hand to copy
+	uint64_t out = 0, last = 0;
+	int ret, err = 0;
+	do
+	{
+		if (!strm.avail_in)
+		{
+			const size_t consumed = (size_t)(strm.next_in ? strm.next_in - index->data : 0);
+			strm.next_in = &index->data[consumed];
+			strm.avail_in = (uInt)MIN(index->size - consumed, UINT_MAX);
+		}
+		if (!strm.avail_out)
+		{
+			strm.next_out = window;
+			strm.avail_out = GZINDEX_WINDOW_SIZE;
+		}
+		const uInt avail = strm.avail_out;
+		ret = inflate(&strm, Z_BLOCK);
+		out += avail - strm.avail_out;
+		if (ret != Z_OK && ret != Z_STREAM_END)
+		{
+			err = ret == Z_MEM_ERROR ? ENOMEM : EINVAL;
+			break;
+		}
+
+		// Inflate stops before each block, except after the last where there's nothing left to resume
+		if ((strm.data_type & 0xC0) == 0x80 && (!index->count || out - last >= span))
+		{
+			const uint32_t windowSize = (uint32_t)MIN(out, GZINDEX_WINDOW_SIZE);
+			GzIndexPoint* point = gzIndexAddPoint(index, windowSize);
+			if (!point)
+			{
+				err = ENOMEM;
+				break;
+			}
+			point->out  = out;
+			point->in   = (uint64_t)(strm.next_in - index->data);
+			point->bits = (uint8_t)(strm.data_type & 0x7);
+
+			// Unwrap the ring, which has only been filled up to the write position so far near the start
+			const size_t head = GZINDEX_WINDOW_SIZE - strm.avail_out, older = windowSize - MIN(head, windowSize);
+			memcpy(point->window, &window[GZINDEX_WINDOW_SIZE - older], older);
+			memcpy(&point->window[older], &window[head - (windowSize - older)], windowSize - older);
+			last = out;
+		}
+	}
+	while (ret != Z_STREAM_END);
+
+	// Readers inflate raw deflate from checkpoints & would stop at the end of the first member
+	if (!err)
+	{
+		for (size_t i = (size_t)(strm.next_in - index->data); i < index->size; ++i)
+		{
+			if (index->data[i])
+			{
+				err = EINVAL;
+				break;
+			}
+		}
+	}
+	inflateEnd(&strm);
+	free(window);
+	if (err)
+	{
+		gzIndexFreePoints(index);
+		return err;
+	}
+	index->length = out;
+	index->span = (uint32_t)span;
+	return 0;
+}
+
+int gzIndexSave(const GzIndex* restrict index, const char* restrict path)
+{
+	assert(index && index->data && path);
+	StreamHandle file;
+	int err = streamFileOpenBuffered(&file, path, "wb", STREAM_BUFFER_DEFAULT_SIZE);
+	if (err)
+		return err;
+
+	// Header: magic, version, compressed size, gzip trailer, uncompressed size, span & checkpoint count
+	streamWrite(file, GZINDEX_MAGIC, 1, 4);
+	streamWriteU32le(file, GZINDEX_VERSION);
+	streamWriteU64le(file, index->size);
+	streamWrite(file, &index->data[index->size - GZINDEX_TRAILER], 1, GZINDEX_TRAILER);
+	streamWriteU64le(file, index->length);
+	streamWriteU32le(file, index->span);
+	streamWriteU32le(file, (uint32_t)index->count);
+	for (size_t i = 0; i < index->count; ++i)
+	{
+		const GzIndexPoint* point = &index->points[i];
+		streamWriteU64le(file, point->out);
+		streamWriteU64le(file, point->in);
+		streamPutC(file, point->bits);
+		streamWriteU32le(file, point->windowSize);
+		streamWrite(file, point->window, 1, point->windowSize);
+	}
+
+	const bool failed = !streamFlush(file) || streamError(file);
+	streamClose(file);
+	if (failed)
+	{
+		remove(path);
+		return EIO;
+	}
+	return 0;
+}
+
+int gzIndexLoad(GzIndex* restrict index, const char* restrict path, size_t span)
+{
+	assert(index && index->data && path);
+	gzIndexFreePoints(index);
+	StreamHandle file;
+	int err = streamMapOpen(&file, path);
+	if (err && (err = streamFileOpenBuffered(&file, path, "rb", STREAM_BUFFER_DEFAULT_SIZE)))
+		return err;
+
+	char magic[4];
+	uint8_t trailer[GZINDEX_TRAILER];
+	uint32_t version, indexSpan, count;
+	uint64_t size, length;
+	if (streamRead(file, magic, 1, 4) != 4 || memcmp(magic, GZINDEX_MAGIC, 4)
+		|| !streamReadU32le(file, &version, 1) || version != GZINDEX_VERSION
+		|| !streamReadU64le(file, &size, 1) || size != index->size || size < GZINDEX_TRAILER
+		|| streamRead(file, trailer, 1, GZINDEX_TRAILER) != GZINDEX_TRAILER
+		|| memcmp(trailer, &index->data[index->size - GZINDEX_TRAILER], GZINDEX_TRAILER)
+		|| !streamReadU64le(file, &length, 1) || !streamReadU32le(file, &indexSpan, 1) || indexSpan != span
+		|| !streamReadU32le(file, &count, 1) || !count)
+	{
+		streamClose(file);
+		return EINVAL;
+	}
+
+	// Check every checkpoint is in range & in order, readers trust them blindly
+	for (uint32_t i = 0; i < count && !err; ++i)
+	{
+		uint64_t out, in;
+		int bits;
+		uint32_t windowSize;
+		GzIndexPoint* point;
+		if (!streamReadU64le(file, &out, 1) || !streamReadU64le(file, &in, 1) || (bits = streamGetC(file)) < 0
+			|| !streamReadU32le(file, &windowSize, 1))
+			err = EINVAL;
+		else if (out > length || in > size || bits > 7 || (bits && !in) || windowSize > GZINDEX_WINDOW_SIZE
+			|| windowSize > out || (i ? out <= index->points[i - 1].out : out != 0))
+			err = EINVAL;
+		else if (!(point = gzIndexAddPoint(index, windowSize)))
+			err = ENOMEM;
+		else
+		{
+			point->out  = out;
+			point->in   = in;
+			point->bits = (uint8_t)bits;
+			if (streamRead(file, point->window, 1, windowSize) != windowSize)
+				err = EINVAL;
+		}
+	}
+	streamClose(file);
+	if (err)
+	{
+		gzIndexFreePoints(index);
+		return err;
+	}
+	index->length = length;
+	index->span = indexSpan;
+	return 0;
+}
+
+
+typedef struct GzIndexReader
+{
+	const GzIndex* index;
+	z_stream strm;
+	uint64_t start;    // Uncompressed offset of buf[0]
+	size_t pos, fill;  // Read cursor & number of valid bytes in buf
+	bool end;          // Inflate reached the end of the stream
+	bool eof, error;
+	uint8_t buf[GZINDEX_READ_SIZE];
+
+} GzIndexReader;
+
+static bool gzIndexReaderResume(GzIndexReader* restrict reader, const GzIndexPoint* restrict point)
+{
+	const GzIndex* index = reader->index;
+	z_stream* strm = &reader->strm;
+	strm->next_in = &index->data[point->in];
+	strm->avail_in = (uInt)MIN(index->size - point->in, UINT_MAX);
+	reader->start = point->out;
+	reader->pos = reader->fill = 0;
+	reader->end = reader->eof = false;
+
+	// Checkpoints are mid-stream so the gzip wrapper is long gone, inflate raw deflate
+	if (inflateReset2(strm, -15) != Z_OK
+		|| (point->bits && inflatePrime(strm, point->bits, index->data[point->in - 1] >> (8 - point->bits)) != Z_OK)
+		|| (point->windowSize && inflateSetDictionary(strm, point->window, point->windowSize) != Z_OK))
+	{
+		reader->error = true;
+		return false;
+	}
+	return true;
+}
+
+// Inflate more data once everything buffered has been read, returns false at the end or on error
+static bool gzIndexReaderFill(GzIndexReader* restrict reader)
+{
+	assert(reader->pos == reader->fill);
+	if (reader->end || reader->error)
+	{
+		reader->eof = reader->end;
+		return false;
+	}
+
+	const size_t keep = MIN(reader->fill, GZINDEX_READ_KEEP);
+	memmove(reader->buf, &reader->buf[reader->fill - keep], keep);
+	reader->start += reader->fill - keep;
+	reader->pos = reader->fill = keep;
+
+	const GzIndex* index = reader->index;
+	z_stream* strm = &reader->strm;
+	strm->next_out = &reader->buf[keep];
+	strm->avail_out = GZINDEX_READ_SIZE - keep;
+	int ret;
+	do
+	{
+		if (!strm->avail_in)
+		{
+			const size_t consumed = (size_t)(strm->next_in - index->data);
+			strm->avail_in = (uInt)MIN(index->size - consumed, UINT_MAX);
+			if (!strm->avail_in)
+			{
+				ret = Z_DATA_ERROR;  // Truncated
+				break;
+			}
+		}
+		ret = inflate(strm, Z_NO_FLUSH);
+	}
+	while (ret == Z_OK && strm->avail_out);
+	reader->fill = GZINDEX_READ_SIZE - strm->avail_out;
+
+	if (ret == Z_STREAM_END)
+		reader->end = true;
+	else if (ret != Z_OK)
+		reader->error = true;
+	if (reader->fill > reader->pos)
+		return true;
+	reader->eof = reader->end;
+	return false;
+}
+
+static bool gzIndexReaderSeekTo(GzIndexReader* restrict reader, uint64_t target)
+{
+	const GzIndex* index = reader->index;
+	if (target > index->length)
+		return false;
+	reader->eof = false;
+	if (target >= reader->start && target <= reader->start + reader->fill)
+	{
+		reader->pos = (size_t)(target - reader->start);
+		return true;
+	}
+
+	// Resume from the last checkpoint at or before target, unless that's behind where we already are
+	size_t lo = 0, hi = index->count;
+	while (hi - lo > 1)
+	{
+		const size_t mid = (lo + hi) / 2;
+		if (index->points[mid].out <= target)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	const GzIndexPoint* point = &index->points[lo];
+	if ((target < reader->start || point->out > reader->start + reader->fill)
+		&& !gzIndexReaderResume(reader, point))
+		return false;
+
+	// Then inflate the rest of the way
+	while (target > reader->start + reader->fill)
+	{
+		reader->pos = reader->fill;
+		if (!gzIndexReaderFill(reader))
+			return false;
+	}
+	reader->pos = (size_t)(target - reader->start);
+	return true;
+}
+
+static size_t streamGzIndexRead(void* restrict user, void* restrict out, size_t size, size_t num)
+{
+	assert(user && out);
+	GzIndexReader* reader = (GzIndexReader*)user;
+	const size_t bytes = size * num;
+	size_t copied = 0;
+	while (copied < bytes)
+	{
+		if (reader->pos == reader->fill && !gzIndexReaderFill(reader))
+			break;
+		const size_t count = MIN(bytes - copied, reader->fill - reader->pos);
+		memcpy(&((uint8_t*)out)[copied], &reader->buf[reader->pos], count);
+		reader->pos += count;
+		copied += count;
+	}
+	return size ? copied / size : 0;
+}
+
+static int streamGzIndexGetC(void* restrict user)
+{
+	assert(user);
+	GzIndexReader* reader = (GzIndexReader*)user;
+	if (fastPath(reader->pos < reader->fill) || gzIndexReaderFill(reader))
+		return reader->buf[reader->pos++];
+	return -1;
+}
+
+static bool streamGzIndexSeek(void* restrict user, int64_t offset, StreamWhence whence)
+{
+	assert(user);
+	GzIndexReader* reader = (GzIndexReader*)user;
+	int64_t base;
+	switch (whence)
+	{
+	case STREAM_SEEK_SET: base = 0; break;
+	case STREAM_SEEK_CUR: base = (int64_t)(reader->start + reader->pos); break;
+	case STREAM_SEEK_END: base = (int64_t)reader->index->length; break;
+	default: return false;
+	}
+	if (offset < -base)
+		return false;
+	return gzIndexReaderSeekTo(reader, (uint64_t)(base + offset));
+}
+
+static bool streamGzIndexTell(void* restrict user, uint64_t* restrict outPosition)
+{
+	assert(user);
+	const GzIndexReader* reader = (const GzIndexReader*)user;
+	*outPosition = reader->start + reader->pos;
+	return true;
+}
+
+static bool streamGzIndexEof(void* restrict user)
+{
+	assert(user);
+	return ((GzIndexReader*)user)->eof;
+}
+
+static bool streamGzIndexError(void* restrict user)
+{
+	assert(user);
+	return ((GzIndexReader*)user)->error;
+}
+
+static void streamGzIndexClose(void* restrict user)
+{
+	GzIndexReader* reader = (GzIndexReader*)user;
+	inflateEnd(&reader->strm);
+	free(reader);
+}
+
+static size_t streamGzIndexBorrow(void* restrict user, const void** restrict outData, size_t size)
+{
+	assert(user && outData);
+	GzIndexReader* reader = (GzIndexReader*)user;
+	if (reader->pos == reader->fill && !gzIndexReaderFill(reader))
+		return 0;
+	size = MIN(size, reader->fill - reader->pos);
+	*outData = &reader->buf[reader->pos];
+	reader->pos += size;
+	return size;
+}
+
+static const StreamIoCb streamGzIndexCb =
+{
+	.read   = streamGzIndexRead,
+	.write  = NULL,
+	.getc   = streamGzIndexGetC,
+	.putc   = NULL,
+	.seek   = streamGzIndexSeek,
+	.tell   = streamGzIndexTell,
+	.eof    = streamGzIndexEof,
+	.error  = streamGzIndexError,
+	.close  = streamGzIndexClose,
+	.borrow = streamGzIndexBorrow
+};
+
+int streamGzIndexOpen(StreamHandle* restrict outHnd, const GzIndex* restrict index)
+{
+	assert(outHnd && index && index->count);
+	GzIndexReader* reader = malloc(sizeof(GzIndexReader));
+	if (!reader)
+		return ENOMEM;
+	memset(&reader->strm, 0, sizeof(z_stream));
+	reader->index = index;
+	reader->error = false;
+	if (inflateInit2(&reader->strm, -15) != Z_OK)
+	{
+		free(reader);
+		return ENOMEM;
+	}
+	if (!gzIndexReaderResume(reader, &index->points[0]))
+	{
+		streamGzIndexClose(reader);
+		return EINVAL;
+	}
+
+	(*outHnd) = (StreamHandle)
+	{
+		.user = (void*)reader,
+		.cb = &streamGzIndexCb
+	};
+	return 0;
+}
+
+#endif
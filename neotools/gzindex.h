@@ -0,0 +1,52 @@
+#ifndef GZINDEX_H
+#define GZINDEX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "stream.h"
+
+#define GZINDEX_EXTENSION     ".idx"     // Appended to the gzip file's path to name its saved index
+#define GZINDEX_WINDOW_SIZE   0x8000     // Deflate history needed to resume inflating mid-stream
+
+// A deflate block boundary inflate can be resumed from without decompressing what came before
+typedef struct GzIndexPoint
+{
+	uint64_t out;         // Uncompressed offset
+	uint64_t in;          // Compressed offset of the first whole byte of the block
+	uint8_t bits;         // Bits at the top of the byte before in that begin the block, 0-7
+	uint32_t windowSize;  // Bytes of history, less than GZINDEX_WINDOW_SIZE near the start
+	uint8_t* window;
+
+} GzIndexPoint;
+
+typedef struct GzIndex
+{
+	StreamHandle source;  // Compressed file, borrowed whole
+	const uint8_t* data;
+	size_t size;
+	uint64_t length;      // Uncompressed size
+	uint32_t span;        // Minimum uncompressed distance between checkpoints
+	GzIndexPoint* points; // In order of offset, the first is always at the start of the data
+	size_t count, reserved;
+
+} GzIndex;
+
+// Take ownership of a gzip stream that can lend its whole contents at once, like a mapped file,
+//  it's closed on failure. Returns 0 or an errno value.
+int gzIndexOpen(GzIndex* restrict index, StreamHandle source);
+void gzIndexClose(GzIndex* restrict index);
+
+// Load checkpoints saved by gzIndexSave, fails if they're missing, unreadable, taken with a different
+//  span or from a different file
+int gzIndexLoad(GzIndex* restrict index, const char* restrict path, size_t span);
+// Inflate the whole stream once recording a checkpoint every span bytes, returns EINVAL if it isn't
+//  a single valid gzip member, in which case it can only be read from the start
+int gzIndexBuild(GzIndex* restrict index, size_t span);
+int gzIndexSave(const GzIndex* restrict index, const char* restrict path);
+
+// Open a read stream over the uncompressed data, supports streamBorrow. Seeks resume inflating from
+//  the nearest checkpoint before the target, so they cost at most span bytes of decompression, and
+//  any number of streams can read from one index concurrently.
+int streamGzIndexOpen(StreamHandle* restrict outHnd, const GzIndex* restrict index);
+
+#endif//GZINDEX_H
@@ -1,5 +1,7 @@
 /* gzstreamfile.c (C) 2023, 2025 a dinosaur (zlib) */
 
+#define _FILE_OFFSET_BITS 64  // Selects gzseek64/gztell64 where available
+
 #include "neoadpcmextract.h"
 #include <errno.h>
 
@@ -19,7 +21,7 @@ static int streamGzGetC(void* restrict user)
 	return gzgetc((gzFile)user);
 }
 
-static bool streamGzFileSeek(void* restrict user, long offset, StreamWhence whence)
+static bool streamGzFileSeek(void* restrict user, int64_t offset, StreamWhence whence)
 {
 	assert(user);
 	int seek;
@@ -30,16 +32,16 @@ static bool streamGzFileSeek(void* restrict user, long offset, StreamWhence when
 	case STREAM_SEEK_END: seek = SEEK_END; break;
 	default: return false;
 	}
-	return gzseek((gzFile)user, offset, seek) ? false : true;
+	return gzseek((gzFile)user, (z_off_t)offset, seek) < 0 ? false : true;
 }
 
-static bool streamGzFileTell(void* restrict user, size_t* restrict outPosition)
+static bool streamGzFileTell(void* restrict user, uint64_t* restrict outPosition)
 {
 	assert(user);
-	const long pos = gztell((gzFile)user);
-	if (pos == -1L)
+	const z_off_t pos = gztell((gzFile)user);
+	if (pos < 0)
 		return false;
-	*outPosition = (size_t)pos;
+	*outPosition = (uint64_t)pos;
 	return true;
 }
 
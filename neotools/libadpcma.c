@@ -2,56 +2,236 @@
    Original ADPCM to PCM converter v 1.01 By MARTINEZ Fabrice aka SNK of SUPREMACY */
 
 #include "adpcm.h"
+#include "nibble.h"
 #include "util.h"
-#include <math.h>
 #include <stdlib.h>
-#include <stdio.h>
 
 #define ADPCMA_VOLUME_RATE 1
 #define ADPCMA_DECODE_RANGE 1024
 #define ADPCMA_DECODE_MIN (-(ADPCMA_DECODE_RANGE * ADPCMA_VOLUME_RATE))
 #define ADPCMA_DECODE_MAX ((ADPCMA_DECODE_RANGE * ADPCMA_VOLUME_RATE) - 1)
+#define ADPCMA_STEP_MAX 48
+#define ADPCMA_NIBBLE_BLOCK 256
 
 
+// Signed difference to add to the signal & the table offset of the next step for one (step, nibble) pair
+typedef struct AdpcmAStep
+{
+	int16_t diff;
+	uint16_t next;
+} AdpcmAStep;
+
+// Step size for step n is floor(16 * 1.1^n), the difference for a nibble is
+//  stepsize * (magnitude * 2 + 1) / 8 negated by the sign bit, the step index moves
+//  by -1 for magnitudes 0-3 & by 2, 5, 7, 9 for magnitudes 4-7
+#define ADPCMA_NEXT(STEP, ADJUST) \
+	(((STEP) + (ADJUST) < 0 ? 0 : (STEP) + (ADJUST) > ADPCMA_STEP_MAX ? ADPCMA_STEP_MAX : (STEP) + (ADJUST)) * 16)
+#define ADPCMA_ENTRY(STEP, SIZE, MAGNITUDE, ADJUST) \
+	{ (SIZE) * ((MAGNITUDE) * 2 + 1) / 8, ADPCMA_NEXT(STEP, ADJUST) }
+#define ADPCMA_NEGATIVE(STEP, SIZE, MAGNITUDE, ADJUST) \
+	{ -((SIZE) * ((MAGNITUDE) * 2 + 1) / 8), ADPCMA_NEXT(STEP, ADJUST) }
+#define ADPCMA_ROW(STEP, SIZE) \
+	ADPCMA_ENTRY(STEP, SIZE, 0, -1), ADPCMA_ENTRY(STEP, SIZE, 1, -1), \
+	ADPCMA_ENTRY(STEP, SIZE, 2, -1), ADPCMA_ENTRY(STEP, SIZE, 3, -1), \
+	ADPCMA_ENTRY(STEP, SIZE, 4, 2),  ADPCMA_ENTRY(STEP, SIZE, 5, 5), \
+	ADPCMA_ENTRY(STEP, SIZE, 6, 7),  ADPCMA_ENTRY(STEP, SIZE, 7, 9), \
+	ADPCMA_NEGATIVE(STEP, SIZE, 0, -1), ADPCMA_NEGATIVE(STEP, SIZE, 1, -1), \
+	ADPCMA_NEGATIVE(STEP, SIZE, 2, -1), ADPCMA_NEGATIVE(STEP, SIZE, 3, -1), \
+	ADPCMA_NEGATIVE(STEP, SIZE, 4, 2),  ADPCMA_NEGATIVE(STEP, SIZE, 5, 5), \
+	ADPCMA_NEGATIVE(STEP, SIZE, 6, 7),  ADPCMA_NEGATIVE(STEP, SIZE, 7, 9)
+
+// One row of 16 nibbles per step, shared read-only by every decoder
+static const AdpcmAStep stepTable[(ADPCMA_STEP_MAX + 1) * 16] =
+{
+	ADPCMA_ROW(0, 16),
+	ADPCMA_ROW(1, 17),
+	ADPCMA_ROW(2, 19),
+	ADPCMA_ROW(3, 21),
+	ADPCMA_ROW(4, 23),
+	ADPCMA_ROW(5, 25),
+	ADPCMA_ROW(6, 28),
+	ADPCMA_ROW(7, 31),
+	ADPCMA_ROW(8, 34),
+	ADPCMA_ROW(9, 37),
+	ADPCMA_ROW(10, 41),
+	ADPCMA_ROW(11, 45),
+	ADPCMA_ROW(12, 50),
+	ADPCMA_ROW(13, 55),
+	ADPCMA_ROW(14, 60),
+	ADPCMA_ROW(15, 66),
+	ADPCMA_ROW(16, 73),
+	ADPCMA_ROW(17, 80),
+	ADPCMA_ROW(18, 88),
+	ADPCMA_ROW(19, 97),
+	ADPCMA_ROW(20, 107),
+	ADPCMA_ROW(21, 118),
+	ADPCMA_ROW(22, 130),
+	ADPCMA_ROW(23, 143),
+	ADPCMA_ROW(24, 157),
+	ADPCMA_ROW(25, 173),
+	ADPCMA_ROW(26, 190),
+	ADPCMA_ROW(27, 209),
+	ADPCMA_ROW(28, 230),
+	ADPCMA_ROW(29, 253),
+	ADPCMA_ROW(30, 279),
+	ADPCMA_ROW(31, 307),
+	ADPCMA_ROW(32, 337),
+	ADPCMA_ROW(33, 371),
+	ADPCMA_ROW(34, 408),
+	ADPCMA_ROW(35, 449),
+	ADPCMA_ROW(36, 494),
+	ADPCMA_ROW(37, 544),
+	ADPCMA_ROW(38, 598),
+	ADPCMA_ROW(39, 658),
+	ADPCMA_ROW(40, 724),
+	ADPCMA_ROW(41, 796),
+	ADPCMA_ROW(42, 876),
+	ADPCMA_ROW(43, 963),
+	ADPCMA_ROW(44, 1060),
+	ADPCMA_ROW(45, 1166),
+	ADPCMA_ROW(46, 1282),
+	ADPCMA_ROW(47, 1411),
+	ADPCMA_ROW(48, 1552)
+};
+
+#undef ADPCMA_ROW
+#undef ADPCMA_NEGATIVE
+#undef ADPCMA_ENTRY
+#undef ADPCMA_NEXT
+
 void adpcmAInit(AdpcmADecoderState* decoder)
 {
-	for (int step = 0; step <= 48; step++)
+	decoder->delta = 0;
+	decoder->cursignal = 0;
+}
+
+void adpcmAEncoderInit(AdpcmAEncoderState* encoder)
+{
+	encoder->flag = false;
+	encoder->cursignal = 0;
+	encoder->delta = 0;
+	encoder->adpcmPack = 0;
+}
+
+// Pack a block of nibbles, completing a byte left half-filled by the previous call first
+static uint8_t* adpcmAEncodeEmit(AdpcmAEncoderState* encoder, uint8_t* restrict out,
+	const uint8_t* restrict nibbles, int count)
+{
+	if (encoder->flag && count)
 	{
-		int stepval = floor(16.0 * pow(11.0 / 10.0, step) * ADPCMA_VOLUME_RATE);
-		// Loop over all nibbles and compute the difference
-		for (int nib = 0; nib < 16; nib++)
+		(*out++) = encoder->adpcmPack | nibbles[0];
+		encoder->flag = false;
+		++nibbles;
+		--count;
+	}
+	nibblePack(out, nibbles, (size_t)(count & ~1));
+	out += count / 2;
+	if (count & 1)
+	{
+		encoder->adpcmPack = (uint8_t)(nibbles[count - 1] << 4);
+		encoder->flag = true;
+	}
+	return out;
+}
+
+void adpcmAEncode(AdpcmAEncoderState* encoder, const int16_t* restrict in, uint8_t* restrict out, int len)
+{
+	int signal = encoder->cursignal, delta = encoder->delta;
+	uint8_t nibbles[ADPCMA_NIBBLE_BLOCK * 2];
+	for (int block = 0; block < len; block += ADPCMA_NIBBLE_BLOCK * 2)
+	{
+		const int count = MIN(len - block, ADPCMA_NIBBLE_BLOCK * 2);
+		for (int i = 0; i < count; ++i)
 		{
-			int value = stepval * ((nib & 0x07) * 2 + 1) / 8;
-			decoder->jediTable[step * 16 + nib] = (nib & 0x08) ? -value : value;
+			// Decoded samples are the signal scaled by 32, round to the nearest level
+			const int target = MIN((in[block + i] + 16) >> 5, ADPCMA_DECODE_MAX);
+			const int dn = target - signal, distance = 2 * abs(dn);
+
+			// Greedily pick the magnitude whose difference lands closest to the target,
+			//  by counting the midpoints between adjacent differences the distance passes
+			const AdpcmAStep* restrict row = &stepTable[delta];
+			unsigned adpcm = 0;
+			for (int m = 1; m < 8; ++m)
+				adpcm += distance >= row[m - 1].diff + row[m].diff;
+			if (dn < 0)
+				adpcm |= 0x8;
+
+			// Track the decoder exactly so that errors don't accumulate
+			const AdpcmAStep step = row[adpcm];
+			signal = CLAMP(signal + step.diff, ADPCMA_DECODE_MIN, ADPCMA_DECODE_MAX);
+			delta = step.next;
+			nibbles[i] = (uint8_t)adpcm;
 		}
+		out = adpcmAEncodeEmit(encoder, out, nibbles, count);
 	}
-
-	decoder->delta = 0;
-	decoder->cursignal = 0;
+	encoder->cursignal = signal;
+	encoder->delta = delta;
 }
 
-static const int decodeTableA1[16] =
+int adpcmAEncodeFlush(AdpcmAEncoderState* encoder, uint8_t* restrict out)
 {
-	-1 * 16, -1 * 16, -1 * 16, -1 * 16, 2 * 16, 5 * 16, 7 * 16, 9 * 16,
-	-1 * 16, -1 * 16, -1 * 16, -1 * 16, 2 * 16, 5 * 16, 7 * 16, 9 * 16
-};
+	if (!encoder->flag)
+		return 0;
+	(*out) = encoder->adpcmPack;
+	encoder->flag = false;
+	return 1;
+}
 
-void adpcmADecode(AdpcmADecoderState* decoder, const char* restrict in, short* restrict out, int len)
+// Shared by the integer & float entry points, only one output pointer is non-NULL,
+//  diagnostics are only gathered when diag is non-NULL
+static FORCE_INLINE void adpcmADecodeSamples(AdpcmADecoderState* decoder, const char* restrict in,
+	short* restrict out, float* restrict outFloat, int len, AdpcmADiagnostics* restrict diag)
 {
-	for (int i = 0; i < len * 2; ++i)
+	int signal = decoder->cursignal, delta = decoder->delta;
+
+	// Expand a block of bytes at a time so the predictor loop just walks nibbles
+	uint8_t nibbles[ADPCMA_NIBBLE_BLOCK * 2];
+	for (int block = 0; block < len; block += ADPCMA_NIBBLE_BLOCK)
 	{
-		int data = (!(i & 0x1) ? ((*in) >> 4) : (*in++)) & 0x0F;
-		int oldsignal = decoder->cursignal;
-		decoder->cursignal = CLAMP(decoder->cursignal + decoder->jediTable[data + decoder->delta],
-			ADPCMA_DECODE_MIN, ADPCMA_DECODE_MAX);
-		decoder->delta = CLAMP(decoder->delta + decodeTableA1[data], 0 * 16, 48 * 16);
-		if (abs(oldsignal - decoder->cursignal) > 2500)
+		const int count = MIN(len - block, ADPCMA_NIBBLE_BLOCK) * 2;
+		nibbleUnpack(nibbles, &in[block], (size_t)count / 2);
+		for (int i = 0; i < count; ++i)
 		{
-			fprintf(stderr, "WARNING: Suspicious signal evolution %06x,%06x pos:%06x delta:%06x\n",
-				oldsignal, decoder->cursignal, i % len, decoder->delta);
-			fprintf(stderr, "data:%02x dx:%08x\n",
-				data, decoder->jediTable[data + decoder->delta]);
+			const AdpcmAStep step = stepTable[delta + nibbles[i]];
+			const int predicted = signal + step.diff;
+			signal = CLAMP(predicted, ADPCMA_DECODE_MIN, ADPCMA_DECODE_MAX);
+			delta = step.next;
+			if (diag && slowPath(predicted != signal))
+			{
+				if (!diag->clipped++)
+					diag->firstClip = diag->samples + (size_t)block * 2 + (size_t)i;
+			}
+			if (outFloat)
+				*(outFloat++) = (float)signal * (1.0f / ADPCMA_DECODE_RANGE);
+			else
+				*(out++) = (short)((signal & 0xffff) * 32);
 		}
-		*(out++) = (decoder->cursignal & 0xffff) * 32;
 	}
+
+	decoder->cursignal = signal;
+	decoder->delta = delta;
+	if (diag)
+		diag->samples += (size_t)len * 2;
+}
+
+void adpcmADecode(AdpcmADecoderState* decoder, const char* restrict in, short* restrict out, int len)
+{
+	adpcmADecodeSamples(decoder, in, out, NULL, len, NULL);
+}
+
+void adpcmADecodeFloat(AdpcmADecoderState* decoder, const char* restrict in, float* restrict out, int len)
+{
+	adpcmADecodeSamples(decoder, in, NULL, out, len, NULL);
+}
+
+void adpcmADecodeDiagnose(AdpcmADecoderState* decoder, const char* restrict in, short* restrict out, int len,
+	AdpcmADiagnostics* restrict diag)
+{
+	adpcmADecodeSamples(decoder, in, out, NULL, len, diag);
+}
+
+void adpcmADecodeFloatDiagnose(AdpcmADecoderState* decoder, const char* restrict in, float* restrict out, int len,
+	AdpcmADiagnostics* restrict diag)
+{
+	adpcmADecodeSamples(decoder, in, NULL, out, len, diag);
 }
@@ -9,6 +9,7 @@
 */
 
 #include "adpcmb.h"
+#include "nibble.h"
 #include "util.h"
 #include <stdlib.h>
 
@@ -19,49 +20,235 @@ static const long stepSizeTable[16] =
 	 57,  57,  57,  57,  77, 102, 128, 153
 };
 
+// Samples searched before the best path is committed, bounds the backtracking storage
+#define ADPCMB_TRELLIS_FRAME 256
+// Bytes expanded to nibbles at a time by the decoder, or packed from them by the encoder
+#define ADPCMB_NIBBLE_BLOCK 256
+
 void adpcmBEncoderInit(AdpcmBEncoderState* encoder)
+{
+	adpcmBEncoderInitTrellis(encoder, 1);
+}
+
+void adpcmBEncoderInitTrellis(AdpcmBEncoderState* encoder, int width)
 {
 	encoder->xn = 0;
 	encoder->stepSize = 127;
 	encoder->flag = false;
 	encoder->adpcmPack = 0;
+	encoder->trellisWidth = CLAMP(width, 1, ADPCMB_TRELLIS_MAX_WIDTH);
 }
 
-void adpcmBEncode(AdpcmBEncoderState* encoder, const int16_t* restrict in, uint8_t* restrict out, int len)
+// Pack encoded nibbles to out & return the new end, a byte left open by an odd count is finished next call
+static uint8_t* adpcmBEncodeEmit(AdpcmBEncoderState* encoder, uint8_t* restrict out,
+	const uint8_t* restrict nibbles, int count)
 {
-	for (int lpc = 0; lpc < len; ++lpc)
+	if (encoder->flag && count)
+	{
+		(*out++) = encoder->adpcmPack | nibbles[0];
+		encoder->flag = false;
+		++nibbles;
+		--count;
+	}
+	nibblePack(out, nibbles, (size_t)(count & ~1));
+	out += count / 2;
+	if (count & 1)
 	{
-		long dn = (*in++) - encoder->xn;
+		encoder->adpcmPack = (uint8_t)(nibbles[count - 1] << 4);
+		encoder->flag = true;
+	}
+	return out;
+}
+
+typedef struct AdpcmBTrellisNode
+{
+	int64_t error;  // Squared error of the path so far
+	long xn, stepSize;
+	uint8_t parent; // Node in the previous sample's beam
+	uint8_t adpcm;
+} AdpcmBTrellisNode;
+
+typedef struct AdpcmBTrellisLink
+{
+	uint8_t parent;
+	uint8_t adpcm;
+} AdpcmBTrellisLink;
+
+// The beam is a max heap on error so the worst path is always at the root
+static FORCE_INLINE void adpcmBTrellisSiftUp(AdpcmBTrellisNode* restrict beam, int i)
+{
+	const AdpcmBTrellisNode node = beam[i];
+	for (int parent; i > 0 && beam[parent = (i - 1) / 2].error < node.error; i = parent)
+		beam[i] = beam[parent];
+	beam[i] = node;
+}
 
-		long i = (labs(dn) << 16) / (encoder->stepSize << 14);
-		i = MIN(i, 7);
-		uint8_t adpcm = i;
+static FORCE_INLINE void adpcmBTrellisSiftDown(AdpcmBTrellisNode* restrict beam, int count, int i)
+{
+	const AdpcmBTrellisNode node = beam[i];
+	for (int child; (child = i * 2 + 1) < count; i = child)
+	{
+		if (child + 1 < count && beam[child + 1].error > beam[child].error)
+			++child;
+		if (beam[child].error <= node.error)
+			break;
+		beam[i] = beam[child];
+	}
+	beam[i] = node;
+}
 
-		i = (adpcm * 2 + 1) * encoder->stepSize / 8;
+// Offer a candidate to the next beam, a path reaching the same decoder state as one already
+//  kept is only interesting if it got there with less error, otherwise the worst path is evicted.
+//  seen is a filter of states offered this sample, so most candidates skip the duplicate search.
+static FORCE_INLINE int adpcmBTrellisOffer(AdpcmBTrellisNode* restrict beam, int count, int width,
+	uint64_t* restrict seen, const AdpcmBTrellisNode* restrict node)
+{
+	// Anything no better than the worst of a full beam can't displace a path, even a duplicate one
+	if (count == width && node->error >= beam[0].error)
+		return count;
 
-		if (dn < 0)
+	const uint64_t bit = UINT64_C(1) << (((unsigned long)node->xn * 31u + (unsigned long)node->stepSize) & 63);
+	if (*seen & bit)
+	{
+		for (int i = 0; i < count; ++i)
 		{
-			adpcm |= 0x8;
-			encoder->xn -= i;
+			if (beam[i].xn != node->xn || beam[i].stepSize != node->stepSize)
+				continue;
+			if (node->error < beam[i].error)
+			{
+				beam[i] = *node;
+				adpcmBTrellisSiftDown(beam, count, i);
+			}
+			return count;
 		}
-		else
+	}
+	*seen |= bit;
+
+	if (count < width)
+	{
+		beam[count] = *node;
+		adpcmBTrellisSiftUp(beam, count);
+		return count + 1;
+	}
+	beam[0] = *node;
+	adpcmBTrellisSiftDown(beam, count, 0);
+	return count;
+}
+
+static void adpcmBEncodeTrellis(AdpcmBEncoderState* encoder, const int16_t* restrict in,
+	uint8_t* restrict out, int len)
+{
+	const int width = encoder->trellisWidth;
+	AdpcmBTrellisNode beams[2][ADPCMB_TRELLIS_MAX_WIDTH];
+	AdpcmBTrellisLink links[ADPCMB_TRELLIS_FRAME][ADPCMB_TRELLIS_MAX_WIDTH];
+	uint8_t path[ADPCMB_TRELLIS_FRAME];
+
+	for (int frameStart = 0; frameStart < len; frameStart += ADPCMB_TRELLIS_FRAME)
+	{
+		const int frameLen = MIN(len - frameStart, ADPCMB_TRELLIS_FRAME);
+		AdpcmBTrellisNode* cur = beams[0], * next = beams[1];
+		cur[0] = (AdpcmBTrellisNode){ .error = 0, .xn = encoder->xn, .stepSize = encoder->stepSize };
+		int count = 1;
+
+		for (int n = 0; n < frameLen; ++n)
 		{
-			encoder->xn += i;
-		}
+			const long sample = in[frameStart + n];
+			int nextCount = 0;
+			uint64_t seen = 0;
+			for (int p = 0; p < count; ++p)
+			{
+				// Try the magnitude the greedy quantiser would pick & its neighbours,
+				//  plus the smallest step the other way for when the nearest overshoots
+				const long dn = sample - cur[p].xn, distance = labs(dn) * 4, stepSize = cur[p].stepSize;
+				int nearest = 0;
+				for (int m = 1; m < 8; ++m)
+					nearest += distance >= m * stepSize;
+				const uint8_t sign = dn < 0 ? 0x8 : 0x0;
+				uint8_t candidates[4];
+				int numCandidates = 0;
+				for (int m = MAX(nearest - 1, 0); m <= MIN(nearest + 1, 7); ++m)
+					candidates[numCandidates++] = (uint8_t)m | sign;
+				if (nearest <= 1)
+					candidates[numCandidates++] = sign ^ 0x8;
 
-		encoder->stepSize = (stepSizeTable[adpcm] * encoder->stepSize) / 64;
-		encoder->stepSize = CLAMP(encoder->stepSize, 127, 24576);
+				for (int c = 0; c < numCandidates; ++c)
+				{
+					const uint8_t adpcm = candidates[c];
+					const long i = ((adpcm & 7) * 2 + 1) * stepSize / 8;
+					long xn = (adpcm & 8) ? cur[p].xn - i : cur[p].xn + i;
+					xn = CLAMP(xn, -32768, 32767);
+					nextCount = adpcmBTrellisOffer(next, nextCount, width, &seen, &(const AdpcmBTrellisNode)
+					{
+						.error    = cur[p].error + (int64_t)(sample - xn) * (sample - xn),
+						.xn       = xn,
+						.stepSize = CLAMP(stepSizeTable[adpcm] * stepSize / 64, 127, 24576),
+						.parent   = (uint8_t)p,
+						.adpcm    = adpcm
+					});
+				}
+			}
+			for (int i = 0; i < nextCount; ++i)
+				links[n][i] = (AdpcmBTrellisLink){ .parent = next[i].parent, .adpcm = next[i].adpcm };
+			AdpcmBTrellisNode* swap = cur;
+			cur = next;
+			next = swap;
+			count = nextCount;
+		}
 
-		if (!encoder->flag)
+		// Commit the best path of this frame & restart the search from where it ends
+		int best = 0;
+		for (int i = 1; i < count; ++i)
+			if (cur[i].error < cur[best].error)
+				best = i;
+		encoder->xn = cur[best].xn;
+		encoder->stepSize = cur[best].stepSize;
+		for (int n = frameLen - 1, node = best; n >= 0; --n)
 		{
-			encoder->adpcmPack = adpcm << 4;
-			encoder->flag = true;
+			path[n] = links[n][node].adpcm;
+			node = links[n][node].parent;
 		}
-		else
+		out = adpcmBEncodeEmit(encoder, out, path, frameLen);
+	}
+}
+
+void adpcmBEncode(AdpcmBEncoderState* encoder, const int16_t* restrict in, uint8_t* restrict out, int len)
+{
+	if (encoder->trellisWidth > 1)
+	{
+		adpcmBEncodeTrellis(encoder, in, out, len);
+		return;
+	}
+
+	uint8_t nibbles[ADPCMB_NIBBLE_BLOCK * 2];
+	for (int block = 0; block < len; block += ADPCMB_NIBBLE_BLOCK * 2)
+	{
+		const int count = MIN(len - block, ADPCMB_NIBBLE_BLOCK * 2);
+		for (int lpc = 0; lpc < count; ++lpc)
 		{
-			(*out++) = encoder->adpcmPack |= adpcm;
-			encoder->flag = false;
+			long dn = in[block + lpc] - encoder->xn;
+
+			long i = (labs(dn) << 16) / (encoder->stepSize << 14);
+			i = MIN(i, 7);
+			uint8_t adpcm = i;
+
+			i = (adpcm * 2 + 1) * encoder->stepSize / 8;
+
+			if (dn < 0)
+			{
+				adpcm |= 0x8;
+				encoder->xn -= i;
+			}
+			else
+			{
+				encoder->xn += i;
+			}
+
+			encoder->stepSize = (stepSizeTable[adpcm] * encoder->stepSize) / 64;
+			encoder->stepSize = CLAMP(encoder->stepSize, 127, 24576);
+
+			nibbles[lpc] = adpcm;
 		}
+		out = adpcmBEncodeEmit(encoder, out, nibbles, count);
 	}
 }
 
@@ -71,22 +258,48 @@ void adpcmBDecoderInit(AdpcmBDecoderState* decoder)
 	decoder->stepSize = 127;
 }
 
-void adpcmBDecode(AdpcmBDecoderState* decoder, const uint8_t* restrict in, int16_t* restrict out, int len)
+static FORCE_INLINE void adpcmBDecodeSamples(AdpcmBDecoderState* decoder, const uint8_t* restrict in,
+	int16_t* restrict out, float* restrict outFloat, int len)
 {
-	for (long lpc = 0; lpc < len * 2; ++lpc)
+	long xn = decoder->xn, stepSize = decoder->stepSize;
+
+	// Expand a block of bytes at a time so the predictor loop just walks nibbles
+	uint8_t nibbles[ADPCMB_NIBBLE_BLOCK * 2];
+	for (int block = 0; block < len; block += ADPCMB_NIBBLE_BLOCK)
 	{
-		uint8_t adpcm = (!(lpc & 0x1) ? (*in) >> 4 : (*in++)) & 0xF;
+		const int count = MIN(len - block, ADPCMB_NIBBLE_BLOCK) * 2;
+		nibbleUnpack(nibbles, &in[block], (size_t)count / 2);
+		for (int lpc = 0; lpc < count; ++lpc)
+		{
+			const uint8_t adpcm = nibbles[lpc];
 
-		long i = ((adpcm & 7) * 2 + 1) * decoder->stepSize / 8;
-		if (adpcm & 8)
-			decoder->xn -= i;
-		else
-			decoder->xn += i;
-		decoder->xn = CLAMP(decoder->xn, -32768, 32767);
+			long i = ((adpcm & 7) * 2 + 1) * stepSize / 8;
+			if (adpcm & 8)
+				xn -= i;
+			else
+				xn += i;
+			xn = CLAMP(xn, -32768, 32767);
 
-		decoder->stepSize = decoder->stepSize * stepSizeTable[adpcm] / 64;
-		decoder->stepSize = CLAMP(decoder->stepSize, 127, 24576);
+			stepSize = stepSize * stepSizeTable[adpcm] / 64;
+			stepSize = CLAMP(stepSize, 127, 24576);
 
-		(*out++) = (int16_t)decoder->xn;
+			if (outFloat)
+				(*outFloat++) = (float)xn * (1.0f / 32768.0f);
+			else
+				(*out++) = (int16_t)xn;
+		}
 	}
+
+	decoder->xn = xn;
+	decoder->stepSize = stepSize;
+}
+
+void adpcmBDecode(AdpcmBDecoderState* decoder, const uint8_t* restrict in, int16_t* restrict out, int len)
+{
+	adpcmBDecodeSamples(decoder, in, out, NULL, len);
+}
+
+void adpcmBDecodeFloat(AdpcmBDecoderState* decoder, const uint8_t* restrict in, float* restrict out, int len)
+{
+	adpcmBDecodeSamples(decoder, in, NULL, out, len);
 }
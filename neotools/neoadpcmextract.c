@@ -6,8 +6,17 @@
 #include "wave.h"
 #include "endian.h"
 #include "util.h"
+#include "simd.h"
+#include "threadpool.h"
+#include "dedup.h"
+#include "pathlist.h"
+#include "gzindex.h"
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <ctype.h>
 
 
 bool bufferResize(Buffer* buf, size_t size)
@@ -26,156 +35,1056 @@ bool bufferResize(Buffer* buf, size_t size)
 	return true;
 }
 
-int vgmReadSample(StreamHandle fin, Buffer* restrict buf)
+// Read a sample's length & step over the fields before its data, returns 0 if there's no data
+static uint32_t vgmSampleLength(StreamHandle fin)
 {
 	uint32_t sampLen;
-	streamReadU32le(fin, &sampLen, 1);       // Get sample data length
+	if (!streamReadU32le(fin, &sampLen, 1))  // Get sample data length
+		return 0;
+	sampLen &= VGM_BLOCK_SIZE_MASK;          // High bit selects the second chip
 	if (sampLen <= 8)
+		return 0;
+
+	streamSkip(fin, 8);                      // Ignore 8 bytes
+	return sampLen - 8;
+}
+
+int vgmReadSample(StreamHandle fin, Buffer* restrict buf, BufferView* restrict outSample)
+{
+	const uint32_t sampLen = vgmSampleLength(fin);
+	if (!sampLen)
 		return 1;
-	sampLen -= 8;
+
+	const void* mapped;
+	const size_t borrowed = streamBorrow(fin, &mapped, sampLen);
+	if (borrowed == sampLen)
+	{
+		// Use adpcm data in place
+		(*outSample) = (BufferView){ mapped, sampLen };
+		return 0;
+	}
 
 	if (!bufferResize(buf, sampLen))         // Resize buffer if needed
-		return false;
-	streamSkip(fin, 8);                      // Ignore 8 bytes
-	streamRead(fin, buf->data, 1, sampLen);  // Read adpcm data
+		return 1;
+	if (borrowed)                            // Keep whatever part was already borrowed
+		memcpy(buf->data, mapped, borrowed);
+	streamRead(fin, &((uint8_t*)buf->data)[borrowed], 1, sampLen - borrowed);  // Read adpcm data
+	(*outSample) = (BufferView){ buf->data, sampLen };
 	return 0;
 }
 
-int vgmScanSample(StreamHandle file)
+int vgmSkipSample(StreamHandle fin, uint64_t* restrict outOffset, size_t* restrict outSize)
+{
+	const uint32_t sampLen = vgmSampleLength(fin);
+	if (!sampLen || !streamTell(fin, outOffset) || !streamSkip(fin, sampLen))
+		return 1;
+	(*outSize) = sampLen;
+	return 0;
+}
+
+int vgmReadHeader(StreamHandle file)
 {
-	// Scan for pcm headers
+	char magic[4];
+	uint32_t version, dataOffset;
+	if (streamRead(file, magic, 1, 4) != 4 || memcmp(magic, "Vgm ", 4))
+		return 1;
+	streamSkip(file, 4);                     // EoF offset
+	if (!streamReadU32le(file, &version, 1))
+		return 1;
+	streamSkip(file, VGM_DATA_OFFSET - 0x0C);
+	if (!streamReadU32le(file, &dataOffset, 1))
+		return 1;
+
+	// Versions before 1.50 always start command data at 0x40, otherwise it's relative to 0x34
+	uint64_t dataStart = VGM_LEGACY_DATA_START;
+	if (version >= 0x150 && dataOffset)
+		dataStart = VGM_DATA_OFFSET + (uint64_t)dataOffset;
+	if (dataStart < VGM_DATA_OFFSET + 4)
+		return 1;
+	streamSkip(file, (int64_t)dataStart - (VGM_DATA_OFFSET + 4));
+	return streamEOF(file) || streamError(file);
+}
+
+// Operand byte count following each opcode, -1 for opcodes that are undefined,
+//  0x66 (end of sound data) & 0x67 (data block) are handled separately
+static const int8_t vgmCommandLengths[0x100] =
+{
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x00
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x10
+	-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x20
+	 1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  1,  // 0x30 Reserved
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  1,  // 0x40 Reserved, 4F GG stereo
+	 1,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  // 0x50 PSG, chip writes (58/59 YM2610)
+	-1,  2,  0,  0, -1, -1, -1, -1, 11, -1, -1, -1, -1, -1, -1, -1,  // 0x60 Waits, 68 PCM RAM write
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x70 Short waits
+	 0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  // 0x80 YM2612 DAC write & wait
+	 4,  4,  5, 10,  1,  4, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,  // 0x90 DAC stream control
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  // 0xA0 Chip writes
+	 2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  2,  // 0xB0
+	 3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // 0xC0
+	 3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  3,  // 0xD0
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  // 0xE0 Seeks & chip writes
+	 4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4,  4   // 0xF0
+};
+
+int vgmNextSample(StreamHandle file)
+{
+	// Step over commands until an ADPCM data block turns up
 	while (true)
 	{
-		if (streamEOF(file) || streamError(file))
+		const int cmd = streamGetC(file);
+		if (cmd < 0 || cmd == 0x66)  // End of sound data
 			return 0;
-		if (streamGetC(file) != 0x67 || streamGetC(file) != 0x66)  // Match data block
+		if (cmd != 0x67)
+		{
+			const int length = vgmCommandLengths[cmd];
+			if (length < 0)
+			{
+				fprintf(stderr, "Unknown VGM command 0x%02X, stopping\n", cmd);
+				return 0;
+			}
+			if (length)
+				streamSkip(file, length);
 			continue;
+		}
+
+		// Data block: 67 66 tt ss ss ss ss
+		if (streamGetC(file) != 0x66)
+			return 0;
 		switch (streamGetC(file))
 		{
 		case 0x82: return 'A';  // 67 66 82 - ADPCM-A
 		case 0x83: return 'B';  // 67 66 83 - ADPCM-B
-		default: return 0;
+		case -1: return 0;
+		default:
+		{
+			uint32_t size;  // Unrelated data block, skip over it
+			if (!streamReadU32le(file, &size, 1))
+				return 0;
+			streamSkip(file, size & VGM_BLOCK_SIZE_MASK);
+			break;
+		}
 		}
 	}
 }
 
+static FORCE_INLINE unsigned countTrailingZeros(uint32_t mask)
+{
+#if defined(__has_builtin) && __has_builtin(__builtin_ctz)
+	return (unsigned)__builtin_ctz(mask);
+#else
+	unsigned count = 0;
+	for (; !(mask & 0x1); mask >>= 1)
+		++count;
+	return count;
+#endif
+}
 
-#define DECODE_BUFFER_SIZE 0x4000
+static FORCE_INLINE bool isBlockHeader(uint8_t a, uint8_t b, uint8_t c)
+{
+	return a == 0x67 && b == 0x66 && (c == 0x82 || c == 0x83);
+}
 
-int writeAdpcmA(int id, const Buffer* enc, Buffer* pcm)
+// Offset of the first 67 66 82/83 sequence wholly inside data, or size if there is none
+static size_t vgmFindBlockHeader(const uint8_t* restrict data, size_t size)
 {
-	char name[32];
-	snprintf(name, sizeof(name), "smpa_%02x.wav", id);
-	StreamHandle fout;
-	if (streamFileOpen(&fout, name, "wb"))
-		return 1;
+	size_t i = 0;
+#if USE_AVX2
+	const __m256i c67 = _mm256_set1_epi8(0x67), c66 = _mm256_set1_epi8(0x66);
+	const __m256i c82 = _mm256_set1_epi8((char)0x82), c83 = _mm256_set1_epi8((char)0x83);
+	for (; i + 34 <= size; i += 32)
+	{
+		const __m256i a = _mm256_loadu_si256((const __m256i*)&data[i]);
+		const __m256i b = _mm256_loadu_si256((const __m256i*)&data[i + 1]);
+		const __m256i c = _mm256_loadu_si256((const __m256i*)&data[i + 2]);
+		const __m256i match = _mm256_and_si256(
+			_mm256_and_si256(_mm256_cmpeq_epi8(a, c67), _mm256_cmpeq_epi8(b, c66)),
+			_mm256_or_si256(_mm256_cmpeq_epi8(c, c82), _mm256_cmpeq_epi8(c, c83)));
+		const uint32_t mask = (uint32_t)_mm256_movemask_epi8(match);
+		if (mask)
+			return i + countTrailingZeros(mask);
+	}
+#endif
+#if USE_SSE2
+	const __m128i c67 = _mm_set1_epi8(0x67), c66 = _mm_set1_epi8(0x66);
+	const __m128i c82 = _mm_set1_epi8((char)0x82), c83 = _mm_set1_epi8((char)0x83);
+	for (; i + 18 <= size; i += 16)
+	{
+		const __m128i a = _mm_loadu_si128((const __m128i*)&data[i]);
+		const __m128i b = _mm_loadu_si128((const __m128i*)&data[i + 1]);
+		const __m128i c = _mm_loadu_si128((const __m128i*)&data[i + 2]);
+		const __m128i match = _mm_and_si128(
+			_mm_and_si128(_mm_cmpeq_epi8(a, c67), _mm_cmpeq_epi8(b, c66)),
+			_mm_or_si128(_mm_cmpeq_epi8(c, c82), _mm_cmpeq_epi8(c, c83)));
+		const uint32_t mask = (uint32_t)_mm_movemask_epi8(match);
+		if (mask)
+			return i + countTrailingZeros(mask);
+	}
+#elif USE_NEON
+	for (; i + 18 <= size; i += 16)
+	{
+		const uint8x16_t a = vld1q_u8(&data[i]), b = vld1q_u8(&data[i + 1]), c = vld1q_u8(&data[i + 2]);
+		const uint8x16_t match = vandq_u8(
+			vandq_u8(vceqq_u8(a, vdupq_n_u8(0x67)), vceqq_u8(b, vdupq_n_u8(0x66))),
+			vorrq_u8(vceqq_u8(c, vdupq_n_u8(0x82)), vceqq_u8(c, vdupq_n_u8(0x83))));
+		// Narrow to 4 bits per lane as there's no movemask
+		const uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(match), 4)), 0);
+		if (mask)
+		{
+			unsigned lane = 0;
+			while (!((mask >> (lane * 4)) & 0xF))
+				++lane;
+			return i + lane;
+		}
+	}
+#endif
+	// Let memchr find candidates for the remainder
+	while (i + 3 <= size)
+	{
+		const uint8_t* found = memchr(&data[i], 0x67, size - i - 2);
+		if (!found)
+			break;
+		i = (size_t)(found - data);
+		if (isBlockHeader(found[0], found[1], found[2]))
+			return i;
+		++i;
+	}
+	return size;
+}
+
+// Plausibility check for a data block header, the stream is positioned just after the type byte
+static bool vgmValidateBlock(StreamHandle file)
+{
+	uint32_t fields[3];  // Block size, ROM size, start address
+	if (streamReadU32le(file, fields, 3) != 3)
+		return false;
+	streamSkip(file, -12);
+	const uint32_t size = fields[0] & VGM_BLOCK_SIZE_MASK;
+	if (size <= 8)
+		return false;
+	// YM2610 sample ROMs have a 24-bit address space
+	const uint64_t romSize = fields[1], start = fields[2];
+	return romSize <= VGM_YM2610_ROM_MAX && (!romSize || start + (size - 8) <= romSize);
+}
+
+#define VGM_SCAN_WINDOW      0x100000
+#define VGM_SCAN_LOCAL_SIZE  0x1000
 
-	// Write wave header
-	const uint32_t decodedSize = enc->size * 2 * sizeof(short);
-	waveWrite(&(const WaveSpec)
+int vgmScanSample(StreamHandle file)
+{
+	// Search borrowed windows (or local copies if the stream can't lend) for candidate headers
+	uint8_t local[VGM_SCAN_LOCAL_SIZE];
+	uint8_t carry[2];  // Tail of the previous window, so headers split across windows are still found
+	size_t carryLen = 0;
+	while (true)
 	{
-		.format    = WAVESPEC_FORMAT_PCM,
+		const uint8_t* window;
+		size_t size;
+		if (file.cb->borrow)
+		{
+			size = streamBorrow(file, (const void**)&window, VGM_SCAN_WINDOW);
+		}
+		else
+		{
+			size = streamRead(file, local, 1, VGM_SCAN_LOCAL_SIZE);
+			window = local;
+		}
+		if (!size)
+			return 0;
+
+		// Headers that begin in the carried over bytes have a negative offset into the window
+		ptrdiff_t found = (ptrdiff_t)size;
+		for (ptrdiff_t j = -(ptrdiff_t)carryLen; j < 0 && j + 2 < (ptrdiff_t)size; ++j)
+		{
+			const uint8_t a = carry[carryLen + j];
+			const uint8_t b = j + 1 < 0 ? carry[carryLen + j + 1] : window[j + 1];
+			if (isBlockHeader(a, b, window[j + 2]))
+			{
+				found = j;
+				break;
+			}
+		}
+		if (found == (ptrdiff_t)size)
+			found = (ptrdiff_t)vgmFindBlockHeader(window, size);
+
+		if (found == (ptrdiff_t)size)
+		{
+			// Nothing here, hold on to the last two bytes
+			uint8_t tail[2 + 2];
+			memcpy(tail, carry, carryLen);
+			const size_t tailLen = carryLen + MIN(size, 2);
+			memcpy(&tail[carryLen], &window[size - MIN(size, 2)], MIN(size, 2));
+			carryLen = MIN(tailLen, 2);
+			memcpy(carry, &tail[tailLen - carryLen], carryLen);
+			continue;
+		}
+
+		// Rewind to just past the type byte & confirm the block looks sane
+		carryLen = 0;
+		streamSkip(file, found + 3 - (ptrdiff_t)size);
+		const int type = window[found + 2] == 0x82 ? 'A' : 'B';
+		if (vgmValidateBlock(file))
+			return type;
+		streamSkip(file, -2);  // Resume right after the rejected 0x67
+	}
+}
+
+
+#define DECODE_BUFFER_SIZE 0x4000
+
+int writeAdpcmA(const char* name, BufferView enc, Buffer* pcm, bool asFloat)
+{
+	WaveWriter fout;
+	const int bytedepth = asFloat ? sizeof(float) : sizeof(short);
+	if (waveWriterFileOpen(&fout, &(const WaveSpec)
+	{
+		.format    = asFloat ? WAVESPEC_FORMAT_FLOAT : WAVESPEC_FORMAT_PCM,
 		.channels  = 1,
 		.rate      = 18500,
-		.bytedepth = 2
-	},
-	NULL, decodedSize, fout);
+		.bytedepth = bytedepth
+	}, name))
+		return 1;
 
-	bufferResize(pcm, DECODE_BUFFER_SIZE * 2 * sizeof(short));
+	bufferResize(pcm, DECODE_BUFFER_SIZE * 2 * bytedepth);
 	AdpcmADecoderState decoder;
 	adpcmAInit(&decoder);
 	size_t decoded = 0;
 	do
 	{
-		const size_t blockSize = MIN(enc->size - decoded, DECODE_BUFFER_SIZE);
-		adpcmADecode(&decoder, &((const char*)enc->data)[decoded], (short*)pcm->data, blockSize);
-		streamWrite(fout, pcm->data, sizeof(short), blockSize * 2);
+		const size_t blockSize = MIN(enc.size - decoded, DECODE_BUFFER_SIZE);
+		if (asFloat)
+			adpcmADecodeFloat(&decoder, &((const char*)enc.data)[decoded], (float*)pcm->data, blockSize);
+		else
+			adpcmADecode(&decoder, &((const char*)enc.data)[decoded], (short*)pcm->data, blockSize);
+		if (waveWriterAppendFrames(&fout, pcm->data, blockSize * 2))
+		{
+			waveWriterClose(&fout);
+			return 1;
+		}
 		decoded += DECODE_BUFFER_SIZE;
 	}
-	while (decoded < enc->size);
+	while (decoded < enc.size);
 
-	streamClose(fout);
-	fprintf(stderr, "Wrote \"%s\"\n", name);
-	return 0;
+	return waveWriterClose(&fout);
 }
 
-int writeAdpcmB(int id, const Buffer* enc, Buffer* pcm)
+int writeAdpcmB(const char* name, BufferView enc, Buffer* pcm, bool asFloat)
 {
-	char name[32];
-	snprintf(name, sizeof(name), "smpb_%02x.wav", id);
-	StreamHandle fout;
-	if (streamFileOpen(&fout, name, "wb"))
-		return 1;
-
-	// Write wave header
-	const uint32_t decodedSize = enc->size * 2 * sizeof(short);
-	waveWrite(&(const WaveSpec)
+	WaveWriter fout;
+	const int bytedepth = asFloat ? sizeof(float) : sizeof(short);
+	if (waveWriterFileOpen(&fout, &(const WaveSpec)
 	{
-		.format    = WAVESPEC_FORMAT_PCM,
+		.format    = asFloat ? WAVESPEC_FORMAT_FLOAT : WAVESPEC_FORMAT_PCM,
 		.channels  = 1,
 		.rate      = 22050,
-		.bytedepth = 2
-	},
-	NULL, decodedSize, fout);
+		.bytedepth = bytedepth
+	}, name))
+		return 1;
 
-	bufferResize(pcm, DECODE_BUFFER_SIZE * 2 * sizeof(short));
+	bufferResize(pcm, DECODE_BUFFER_SIZE * 2 * bytedepth);
 	AdpcmBDecoderState decoder;
 	adpcmBDecoderInit(&decoder);
 	size_t decoded = 0;
 	do
 	{
-		const size_t blockSize = MIN(enc->size - decoded, DECODE_BUFFER_SIZE);
-		adpcmBDecode(&decoder, &((const uint8_t*)enc->data)[decoded], (int16_t*)pcm->data, blockSize);
-		streamWrite(fout, pcm->data, sizeof(int16_t), blockSize * 2);
+		const size_t blockSize = MIN(enc.size - decoded, DECODE_BUFFER_SIZE);
+		if (asFloat)
+			adpcmBDecodeFloat(&decoder, &((const uint8_t*)enc.data)[decoded], (float*)pcm->data, blockSize);
+		else
+			adpcmBDecode(&decoder, &((const uint8_t*)enc.data)[decoded], (int16_t*)pcm->data, blockSize);
+		if (waveWriterAppendFrames(&fout, pcm->data, blockSize * 2))
+		{
+			waveWriterClose(&fout);
+			return 1;
+		}
 		decoded += DECODE_BUFFER_SIZE;
 	}
-	while (decoded < enc->size);
+	while (decoded < enc.size);
 
-	streamClose(fout);
-	fprintf(stderr, "Wrote \"%s\"\n", name);
-	return 0;
+	return waveWriterClose(&fout);
 }
 
 
-int main(int argc, char** argv)
+typedef struct
 {
-	if (argc != 2)
-		return 1;
+	int type;         // 'A' or 'B'
+	uint64_t offset;  // Position of the block data in the file, for reporting
+	BufferView sample;
+	Buffer owned;     // Copy of the block data when the stream can't keep it around
+	const GzIndex* source;  // Index the data is inflated from by the decoding thread, NULL if already read
+	uint64_t sourceOffset;
+	DedupEntry entry; // Hash & output name of the block
+	const char* dir;  // Directory entry.name lives in, NULL for the working directory
+	size_t id;        // Index among blocks of the same type in the input
+	bool duplicate;   // Already decoded in this or a previous run, only gets a manifest record
+	bool added;       // Added to the dedup index by this run, taken out again if it isn't written
+	bool floatOut;    // Write 32-bit float samples rather than 16-bit PCM
+	int result;
+
+} AdpcmBlock;
+
+typedef struct { AdpcmBlock* blocks; size_t count, reserved; } BlockList;
+
+typedef struct
+{
+	const char* path;
+	char* outDir;          // Where the input's blocks are written, NULL for the working directory
+	StreamHandle file;     // Held open until the blocks are decoded so mapped data can be used in place
+	GzIndex* gzIndex;      // Checkpoints of an indexed .vgz, also held until its blocks are decoded
+	size_t firstBlock, numBlocks;
+	int result;
+
+} ExtractInput;
 
-	StreamHandle file; // Open file
-	if (streamGzFileOpen(&file, argv[1], "rb"))
+typedef struct
+{
+	const char* outRoot;   // Output directory given with -o, NULL for the working directory
+	DedupIndex* dedup;     // Non-NULL when deduplicating against a manifest
+	bool collisionCheck;
+	size_t indexSpan;      // Checkpoint spacing when indexing .vgz inputs, 0 to inflate them sequentially
+	bool floatOut;         // Decode to 32-bit float samples instead of 16-bit PCM
+
+} ExtractOptions;
+
+static AdpcmBlock* blockListAdd(BlockList* list)
+{
+	if (list->count == list->reserved)
+	{
+		const size_t reserve = list->reserved ? list->reserved * 2 : 64;
+		AdpcmBlock* blocks = realloc(list->blocks, sizeof(AdpcmBlock) * reserve);
+		if (!blocks)
+			return NULL;
+		list->blocks = blocks;
+		list->reserved = reserve;
+	}
+	return &list->blocks[list->count++];
+}
+
+#if USE_ZLIB
+// Inflate a block's data from its input's index through a reader of our own
+static int inflateBlock(AdpcmBlock* restrict block)
+{
+	StreamHandle reader;
+	if (streamGzIndexOpen(&reader, block->source))
 		return 1;
+	const bool ok = streamSeek(reader, (int64_t)block->sourceOffset, STREAM_SEEK_SET)
+		&& bufferResize(&block->owned, block->sample.size)
+		&& streamRead(reader, block->owned.data, 1, block->sample.size) == block->sample.size;
+	streamClose(reader);
+	block->sample.data = block->owned.data;
+	return !ok;
+}
+#endif
+
+static void decodeBlock(void* user)
+{
+	AdpcmBlock* block = (AdpcmBlock*)user;
 
-#if !USE_ZLIB
-	if (streamGetC(file) == 0x1F && streamGetC(file) == 0x8B)
+	// Decode through a fixed stack buffer so workers never allocate, sized for float samples
+	float pcmData[DECODE_BUFFER_SIZE * 2];
+	Buffer pcm = { pcmData, 0, sizeof(pcmData) };
+
+	char* path = block->dir ? pathJoin(block->dir, block->entry.name) : NULL;
+	if (block->dir && !path)
+		block->result = 1;
+#if USE_ZLIB
+	else if (block->source && inflateBlock(block))
+		block->result = 1;
+#endif
+	else if (block->type == 'A')
+		block->result = writeAdpcmA(path ? path : block->entry.name, block->sample, &pcm, block->floatOut);
+	else
+		block->result = writeAdpcmB(path ? path : block->entry.name, block->sample, &pcm, block->floatOut);
+	free(path);
+
+	free(block->owned.data);
+	block->owned = (Buffer)BUFFER_CLEAR();
+}
+
+#if USE_ZLIB
+// Read a mapped .vgz through checkpoints saved beside it, indexing it first if they're missing or stale
+static int openIndexed(StreamHandle* restrict outFile, GzIndex** restrict outIndex, StreamHandle source,
+	const char* restrict path, size_t span)
+{
+	GzIndex* index = malloc(sizeof(GzIndex));
+	char* indexPath = malloc(strlen(path) + sizeof(GZINDEX_EXTENSION));
+	if (!index || !indexPath)
+	{
+		free(indexPath);
+		free(index);
+		streamClose(source);
+		return ENOMEM;
+	}
+	sprintf(indexPath, "%s" GZINDEX_EXTENSION, path);
+
+	int err = gzIndexOpen(index, source);
+	if (!err && gzIndexLoad(index, indexPath, span))
+	{
+		fprintf(stderr, "%s: indexing\n", path);
+		if (!(err = gzIndexBuild(index, span)) && gzIndexSave(index, indexPath))
+			fprintf(stderr, "%s: couldn't save index \"%s\"\n", path, indexPath);
+	}
+	free(indexPath);
+	if (!err && !(err = streamGzIndexOpen(outFile, index)))
 	{
-		fprintf(stderr, "I'm a little gzip short and stout\n");
-		return 2;
+		(*outIndex) = index;
+		return 0;
 	}
-	streamSeek(file, 0, STREAM_SEEK_SET);
+	gzIndexClose(index);
+	free(index);
+	return err;
+}
 #endif
 
-	Buffer rawbuf = BUFFER_CLEAR(), decbuf = BUFFER_CLEAR();
-	int smpaCount = 0, smpbCount = 0;
+static int openInput(StreamHandle* restrict outFile, bool* restrict outMapped, GzIndex** restrict outIndex,
+	const char* restrict path, size_t indexSpan)
+{
+	StreamHandle file; // Open file, mapped if possible
+	bool mapped = false;
+	if (!streamMapOpen(&file, path))
+	{
+		const bool gzipped = streamGetC(file) == 0x1F && streamGetC(file) == 0x8B;
+		streamSeek(file, 0, STREAM_SEEK_SET);
+		mapped = true;
+		if (gzipped)
+		{
+#if USE_ZLIB
+			mapped = false;
+			if (indexSpan && !openIndexed(outFile, outIndex, file, path, indexSpan))
+			{
+				(*outMapped) = false;
+				return 0;
+			}
+			if (indexSpan)
+				fprintf(stderr, "%s: can't be indexed, inflating sequentially\n", path);
+			else
+				streamClose(file);
+			file.cb = NULL;
+#else
+			streamClose(file);
+			fprintf(stderr, "I'm a little gzip short and stout\n");
+			return 2;
+#endif
+		}
+	}
+	else
+	{
+		file.cb = NULL;
+	}
+
+	// Fall back to buffered (de)compression if the file couldn't be mapped
+	if (!file.cb)
+	{
+		StreamHandle raw;
+		if (streamGzFileOpen(&raw, path, "rb"))
+			return 1;
+		if (streamBufferOpen(&file, raw, NULL, STREAM_BUFFER_DEFAULT_SIZE))
+		{
+			streamClose(raw);
+			return 1;
+		}
+	}
+
+	(*outFile) = file;
+	(*outMapped) = mapped;
+	return 0;
+}
+
+static unsigned hexDigits(size_t value)
+{
+	unsigned digits = 1;
+	while (value >>= 4)
+		++digits;
+	return digits;
+}
+
+// Find the ADPCM blocks in an input & append them to list, the stream is left open
+static int scanInput(ExtractInput* restrict input, BlockList* restrict list, const ExtractOptions* restrict opts)
+{
+	bool mapped;
+	input->firstBlock = list->count;
+	input->numBlocks = 0;
+	input->file.cb = NULL;
+	input->gzIndex = NULL;
+	int err = openInput(&input->file, &mapped, &input->gzIndex, input->path, opts->indexSpan);
+	if (err)
+	{
+		fprintf(stderr, "%s: couldn't open file\n", input->path);
+		return err;
+	}
+
+	// Walk the command stream if there's a usable header, otherwise search for anything resembling a data block
+	StreamHandle file = input->file;
+	int (*nextSample)(StreamHandle) = vgmNextSample;
+	if (vgmReadHeader(file))
+	{
+		fprintf(stderr, "%s: no valid VGM header, scanning for data blocks\n", input->path);
+		streamSeek(file, 0, STREAM_SEEK_SET);
+		nextSample = vgmScanSample;
+	}
 
-	// Find ADCPM samples
+	// Content hashes need the data while scanning, otherwise indexed inputs leave it to the workers
+	const bool deferred = input->gzIndex && !opts->dedup;
+	size_t smpaCount = 0, smpbCount = 0;
 	int scanType;
-	while ((scanType = vgmScanSample(file)))
+	while ((scanType = nextSample(file)))
 	{
-		size_t offset;
+		uint64_t offset = 0;
 		if (streamTell(file, &offset))
-			fprintf(stderr, "ADPCM-%c data found at 0x%08zX\n", scanType, offset);
+			fprintf(stderr, "ADPCM-%c data found at 0x%08" PRIX64 "\n", scanType, offset);
 
-		if (vgmReadSample(file, &rawbuf) || rawbuf.size == 0)
+		Buffer owned = BUFFER_CLEAR();
+		BufferView sample = { NULL, 0 };
+		uint64_t sourceOffset = 0;
+		if (deferred)
+		{
+			// Seek past the data, whoever decodes the block inflates it from the nearest checkpoint
+			if (vgmSkipSample(file, &sourceOffset, &sample.size))
+				continue;
+		}
+		else if (vgmReadSample(file, &owned, &sample) || sample.size == 0)
+		{
+			free(owned.data);
 			continue;
+		}
 
-		if (scanType == 'A')
-			writeAdpcmA(smpaCount++, &rawbuf, &decbuf);
-		else if (scanType == 'B')
-			writeAdpcmB(smpbCount++, &rawbuf, &decbuf);
+		// Only mapped data outlives the next stream read
+		if (!mapped && !deferred && sample.data != owned.data)
+		{
+			if (!bufferResize(&owned, sample.size))
+			{
+				fprintf(stderr, "Out of memory\n");
+				return 1;
+			}
+			memcpy(owned.data, sample.data, sample.size);
+			sample.data = owned.data;
+		}
+
+		AdpcmBlock* block = blockListAdd(list);
+		if (!block)
+		{
+			free(owned.data);
+			fprintf(stderr, "Out of memory\n");
+			return 1;
+		}
+		++input->numBlocks;
+		(*block) = (AdpcmBlock)
+		{
+			.type   = scanType,
+			.offset = offset,
+			.sample = sample,
+			.owned  = owned,
+			.source = deferred ? input->gzIndex : NULL,
+			.sourceOffset = sourceOffset,
+			.entry  = { .hash = 0, .size = (uint32_t)sample.size, .type = (char)scanType, .data = NULL },
+			.dir    = input->outDir,
+			.id     = scanType == 'A' ? smpaCount++ : smpbCount++,
+			.duplicate = false,
+			.added  = false,
+			.floatOut = opts->floatOut,
+			.result = 0
+		};
+		block->entry.name[0] = '\0';  // Named once the final count is known
+		if (!opts->dedup)
+			continue;
+
+		// Hash the raw block & look for an earlier copy, naming new blocks after their content
+		const uint64_t hash = dedupHash64(sample.data, sample.size, 0);
+		const DedupEntry* found = dedupIndexFind(opts->dedup, hash, (char)scanType, NULL, sample.size);
+		block->entry.hash = hash;
+		if (found && opts->collisionCheck
+			&& !dedupIndexFind(opts->dedup, hash, (char)scanType, sample.data, sample.size))
+		{
+			fprintf(stderr, "Hash collision at 0x%08" PRIX64 ", decoding separately\n", offset);
+			continue;
+		}
+		if (found)
+		{
+			block->entry = *found;
+			block->duplicate = true;
+		}
+		else
+		{
+			snprintf(block->entry.name, DEDUP_NAME_MAX, scanType == 'A' ? "smpa_%016" PRIx64 ".wav"
+				: "smpb_%016" PRIx64 ".wav", hash);
+			if (dedupIndexAdd(opts->dedup, hash, (char)scanType, sample.data, sample.size, block->entry.name))
+			{
+				fprintf(stderr, "Out of memory\n");
+				return 1;
+			}
+			block->added = true;
+		}
+		// Content named blocks are shared between inputs
+		block->dir = opts->outRoot;
 	}
 
-	free(rawbuf.data);
-	streamClose(file);
+	// Blocks are numbered in file order so names don't depend on decode order, wide enough for every block
+	const int widthA = (int)MAX(2, hexDigits(smpaCount ? smpaCount - 1 : 0));
+	const int widthB = (int)MAX(2, hexDigits(smpbCount ? smpbCount - 1 : 0));
+	bool madeDir = false;
+	for (size_t i = input->firstBlock; i < list->count; ++i)
+	{
+		AdpcmBlock* block = &list->blocks[i];
+		if (block->entry.name[0])
+			continue;
+		// Only inputs that have something of their own to write get a folder
+		if (input->outDir && !madeDir)
+		{
+			if ((err = pathMakeDirectories(input->outDir)))
+			{
+				fprintf(stderr, "%s: couldn't create \"%s\"\n", input->path, input->outDir);
+				for (size_t j = input->firstBlock; j < list->count; ++j)
+				{
+					// None of these get written, so later duplicates mustn't count on them or their data
+					if (list->blocks[j].added)
+						dedupIndexRemove(opts->dedup, &list->blocks[j].entry);
+					free(list->blocks[j].owned.data);
+				}
+				list->count = input->firstBlock;
+				input->numBlocks = 0;
+				return 1;
+			}
+			madeDir = true;
+		}
+		if (block->type == 'A')
+			snprintf(block->entry.name, DEDUP_NAME_MAX, "smpa_%0*zx.wav", widthA, block->id);
+		else
+			snprintf(block->entry.name, DEDUP_NAME_MAX, "smpb_%0*zx.wav", widthB, block->id);
+	}
 	return 0;
 }
+
+// Report & record an input's blocks in file order, returns non-zero if any failed
+static int finishInput(ExtractInput* restrict input, BlockList* restrict list, const ExtractOptions* restrict opts)
+{
+	int ret = input->result;
+	for (size_t i = 0; i < input->numBlocks; ++i)
+	{
+		AdpcmBlock* block = &list->blocks[input->firstBlock + i];
+		const char* dir = block->dir ? block->dir : "";
+		const char* sep = block->dir ? "/" : "";
+		// Originals precede their duplicates & are dropped from the index when they fail,
+		//  so a duplicate whose entry is gone has no file behind it
+		if (block->duplicate && !block->result)
+		{
+			const DedupEntry* original = dedupIndexFind(opts->dedup, block->entry.hash, block->entry.type, NULL,
+				block->entry.size);
+			if (!original || strcmp(original->name, block->entry.name))
+				block->result = 1;
+		}
+		if (block->result)
+		{
+			if (block->added)
+				dedupIndexRemove(opts->dedup, &block->entry);
+			fprintf(stderr, "Failed to write \"%s%s%s\" (%s block at 0x%08" PRIX64 ")\n",
+				dir, sep, block->entry.name, input->path, block->offset);
+			ret = 1;
+		}
+		else
+		{
+			fprintf(stderr, block->duplicate ? "Skipped duplicate of \"%s%s%s\"\n" : "Wrote \"%s%s%s\"\n",
+				dir, sep, block->entry.name);
+			// Manifest names are relative to the output root
+			if (opts->dedup && block->dir == opts->outRoot)
+				dedupIndexRecord(opts->dedup, &block->entry, input->path, (unsigned)i);
+		}
+		free(block->owned.data);
+		block->owned = (Buffer)BUFFER_CLEAR();
+	}
+	if (input->file.cb)
+		streamClose(input->file);
+	input->file.cb = NULL;
+#if USE_ZLIB
+	if (input->gzIndex)
+	{
+		gzIndexClose(input->gzIndex);
+		free(input->gzIndex);
+	}
+#endif
+	input->gzIndex = NULL;
+	return ret;
+}
+
+// Output folder for an input in batch mode: its path below the listed directory, or its file name, minus extension
+static char* inputOutDir(const char* root, const char* path, size_t baseLen)
+{
+	const char* rel = &path[baseLen];
+	while (*rel == '/' || *rel == '\\')
+		++rel;
+	if (!baseLen)
+	{
+		const char* slash = strrchr(path, '/');
+		const char* bslash = strrchr(path, '\\');
+		rel = MAX(slash, bslash) ? MAX(slash, bslash) + 1 : path;
+	}
+	const char* ext = strrchr(rel, '.');
+	const size_t stemLen = (ext && ext != rel && !strpbrk(ext, "/\\")) ? (size_t)(ext - rel) : strlen(rel);
+	char* stem = malloc(stemLen + 1);
+	if (!stem)
+		return NULL;
+	memcpy(stem, rel, stemLen);
+	stem[stemLen] = '\0';
+	char* dir = pathJoin(root, stem);
+	free(stem);
+	return dir;
+}
+
+// Folders are compared ignoring case, as they would be on Windows & macOS
+static int compareFolders(const char* a, const char* b)
+{
+	for (; *a && tolower((unsigned char)*a) == tolower((unsigned char)*b); ++a, ++b);
+	return tolower((unsigned char)*a) - tolower((unsigned char)*b);
+}
+
+static int compareInputFolders(const void* a, const void* b)
+{
+	const ExtractInput* x = *(const ExtractInput* const*)a;
+	const ExtractInput* y = *(const ExtractInput* const*)b;
+	const int cmp = compareFolders(x->outDir, y->outDir);
+	return cmp ? cmp : (x > y) - (x < y);  // Input order within a folder
+}
+
+static bool folderTaken(ExtractInput* const* sorted, size_t count, const char* dir)
+{
+	size_t lo = 0, hi = count;
+	while (lo < hi)
+	{
+		const size_t mid = (lo + hi) / 2;
+		const int cmp = compareFolders(sorted[mid]->outDir, dir);
+		if (!cmp)
+			return true;
+		if (cmp < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return false;
+}
+
+// Inputs that share a folder, like x.vgm & x.vgz or a/x.vgz & b/x.vgz listed separately, would
+//  write over each other's samples, so all but the first get the next free numeric suffix
+static bool separateOutDirs(ExtractInput* inputs, size_t count)
+{
+	ExtractInput** sorted = malloc(sizeof(ExtractInput*) * MAX(count, 1));
+	char** renamed = calloc(MAX(count, 1), sizeof(char*));
+	bool ok = sorted && renamed;
+	if (ok)
+	{
+		for (size_t i = 0; i < count; ++i)
+			sorted[i] = &inputs[i];
+		qsort(sorted, count, sizeof(ExtractInput*), compareInputFolders);
+	}
+
+	// New names are only checked against the originals, suffixed names can't collide among themselves
+	for (size_t i = 1, first = 0, suffix = 2; ok && i < count; ++i)
+	{
+		if (compareFolders(sorted[first]->outDir, sorted[i]->outDir))
+		{
+			first = i;
+			suffix = 2;
+			continue;
+		}
+		const size_t len = strlen(sorted[first]->outDir) + 24;
+		char* dir = NULL;
+		do
+		{
+			free(dir);
+			if ((dir = malloc(len)))
+				snprintf(dir, len, "%s_%zu", sorted[first]->outDir, suffix++);
+		}
+		while (dir && folderTaken(sorted, count, dir));
+		ok = (renamed[sorted[i] - inputs] = dir) != NULL;
+	}
+
+	for (size_t i = 0; ok && i < count; ++i)
+	{
+		if (!renamed[i])
+			continue;
+		fprintf(stderr, "%s: \"%s\" is taken by another input, writing to \"%s\"\n",
+			inputs[i].path, inputs[i].outDir, renamed[i]);
+		free(inputs[i].outDir);
+		inputs[i].outDir = renamed[i];
+		renamed[i] = NULL;
+	}
+	if (renamed)
+		for (size_t i = 0; i < count; ++i)
+			free(renamed[i]);
+	free(renamed);
+	free(sorted);
+	return ok;
+}
+
+static void usage(const char* argv0)
+{
+	fprintf(stderr, "Usage: %s [options] <file.vgm|directory>...\n", argv0);
+	fprintf(stderr, "  -o dir       Write each input's samples to a subfolder of dir\n");
+	fprintf(stderr, "  -r           Descend into subdirectories\n");
+	fprintf(stderr, "  -j threads   Number of decoding threads (default: number of CPUs)\n");
+	fprintf(stderr, "  -f files     Number of inputs to scan & decode at once (default: 4)\n");
+	fprintf(stderr, "  -m manifest  Skip blocks already listed in manifest & record new ones, deduplicated\n");
+	fprintf(stderr, "               blocks are named after their content hash & shared between inputs\n");
+	fprintf(stderr, "  -c           Compare duplicate blocks byte for byte to rule out hash collisions\n");
+	fprintf(stderr, "  -F           Write 32-bit float samples instead of 16-bit PCM\n");
+	fprintf(stderr, "  -i MiB       Index .vgz inputs with inflate checkpoints every MiB, saved beside them as\n");
+	fprintf(stderr, "               .vgz%s & reused, so sample data is inflated in parallel by the decoding threads\n",
+		GZINDEX_EXTENSION);
+	fprintf(stderr, "A single file without -o is extracted to the working directory\n");
+	exit(1);
+}
+
+int main(int argc, char** argv)
+{
+	int numThreads = 0, filesInFlight = 4, argIdx = 1;
+	const char* manifestPath = NULL;
+	bool collisionCheck = false, recursive = false;
+	ExtractOptions opts = { .outRoot = NULL, .dedup = NULL, .collisionCheck = false, .indexSpan = 0,
+		.floatOut = false };
+	for (; argIdx < argc && argv[argIdx][0] == '-'; ++argIdx)
+	{
+		if (!strcmp(argv[argIdx], "-j") && argIdx + 1 < argc)
+		{
+			if ((numThreads = atoi(argv[++argIdx])) <= 0)
+				usage(argv[0]);
+		}
+		else if (!strcmp(argv[argIdx], "-f") && argIdx + 1 < argc)
+		{
+			if ((filesInFlight = atoi(argv[++argIdx])) <= 0)
+				usage(argv[0]);
+		}
+		else if (!strcmp(argv[argIdx], "-i") && argIdx + 1 < argc)
+		{
+			const int span = atoi(argv[++argIdx]);
+			if (span <= 0 || span > 1024)
+				usage(argv[0]);
+			opts.indexSpan = (size_t)span * 0x100000;
+		}
+		else if (!strcmp(argv[argIdx], "-o") && argIdx + 1 < argc)
+			opts.outRoot = argv[++argIdx];
+		else if (!strcmp(argv[argIdx], "-m") && argIdx + 1 < argc)
+			manifestPath = argv[++argIdx];
+		else if (!strcmp(argv[argIdx], "-c"))
+			collisionCheck = true;
+		else if (!strcmp(argv[argIdx], "-r"))
+			recursive = true;
+		else if (!strcmp(argv[argIdx], "-F"))
+			opts.floatOut = true;
+		else
+			usage(argv[0]);
+	}
+	if (argIdx >= argc)
+		usage(argv[0]);
+	opts.collisionCheck = collisionCheck;
+
+	// Gather inputs, remembering how much of each path is the directory it was listed from
+	static const char* const extensions[] = { "vgm", "vgz", NULL };
+	PathList paths = PATHLIST_CLEAR();
+	size_t* baseLens = NULL;
+	int ret = 0;
+	for (int i = argIdx; i < argc; ++i)
+	{
+		const size_t first = paths.count;
+		const bool isDir = pathIsDirectory(argv[i]);
+		const bool ok = isDir
+			? pathListAddDirectory(&paths, argv[i], extensions, recursive)
+			: pathListAdd(&paths, argv[i]);
+		size_t* newLens = realloc(baseLens, sizeof(size_t) * MAX(paths.count, 1));
+		if (!ok || !newLens)
+		{
+			fprintf(stderr, "%s: couldn't list inputs\n", argv[i]);
+			free(newLens ? newLens : baseLens);
+			pathListFree(&paths);
+			return 1;
+		}
+		baseLens = newLens;
+		for (size_t j = first; j < paths.count; ++j)
+			baseLens[j] = isDir ? strlen(argv[i]) : 0;
+	}
+
+	// A lone file keeps extracting to the output root, batches get a folder per input
+	const bool batch = paths.count != 1 || baseLens[0] || opts.outRoot;
+	ExtractInput* inputs = calloc(MAX(paths.count, 1), sizeof(ExtractInput));
+	if (!inputs)
+	{
+		free(baseLens);
+		pathListFree(&paths);
+		return 1;
+	}
+	for (size_t i = 0; i < paths.count; ++i)
+	{
+		inputs[i].path = paths.paths[i];
+		if (batch && !(inputs[i].outDir = inputOutDir(opts.outRoot ? opts.outRoot : ".", paths.paths[i], baseLens[i])))
+			ret = 1;
+	}
+	free(baseLens);
+	if (batch && !ret && !separateOutDirs(inputs, paths.count))
+		ret = 1;
+	if (opts.outRoot && pathMakeDirectories(opts.outRoot))
+	{
+		fprintf(stderr, "Couldn't create \"%s\"\n", opts.outRoot);
+		ret = 1;
+	}
+
+	DedupIndex dedup;
+	if (!ret && manifestPath)
+	{
+		if (dedupIndexOpen(&dedup, manifestPath))
+		{
+			fprintf(stderr, "Couldn't open manifest \"%s\"\n", manifestPath);
+			ret = 1;
+		}
+		else
+		{
+			opts.dedup = &dedup;
+		}
+	}
+
+	// Blocks have independent decoder state, so decode & write them concurrently
+	ThreadPool* pool = NULL;
+	if (!numThreads)
+		numThreads = threadPoolDefaultThreads();
+	if (numThreads > 1 && threadPoolCreate(&pool, numThreads, numThreads * 2))
+		pool = NULL;
+
+	// Scan a few inputs, decode all of their blocks together, then report them in input order
+	BlockList list = { NULL, 0, 0 };
+	bool failed = false;
+	for (size_t first = 0; !ret && first < paths.count; first += (size_t)filesInFlight)
+	{
+		const size_t last = MIN(paths.count, first + (size_t)filesInFlight);
+		list.count = 0;
+		for (size_t i = first; i < last; ++i)
+			inputs[i].result = scanInput(&inputs[i], &list, &opts);
+
+		for (size_t i = 0; i < list.count; ++i)
+		{
+			if (list.blocks[i].duplicate)
+				continue;
+			if (pool)
+				threadPoolSubmit(pool, decodeBlock, &list.blocks[i]);
+			else
+				decodeBlock(&list.blocks[i]);
+		}
+		if (pool)
+			threadPoolWait(pool);
+
+		for (size_t i = first; i < last; ++i)
+			if (finishInput(&inputs[i], &list, &opts))
+				failed = true;
+		// Block data from this batch is about to go away
+		if (opts.dedup)
+			dedupIndexReleaseData(opts.dedup);
+	}
+	if (failed)
+		ret = 1;
+
+	if (pool)
+		threadPoolDestroy(pool);
+	if (opts.dedup)
+		dedupIndexClose(opts.dedup);
+	free(list.blocks);
+	for (size_t i = 0; i < paths.count; ++i)
+		free(inputs[i].outDir);
+	free(inputs);
+	pathListFree(&paths);
+	return ret;
+}
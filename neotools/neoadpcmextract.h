@@ -10,9 +10,24 @@
 typedef struct { void* data; size_t size, reserved; } Buffer;
 #define BUFFER_CLEAR() { NULL, 0, 0 }
 
+// Non-owning view of either a Buffer or data borrowed from a stream
+typedef struct { const void* data; size_t size; } BufferView;
+
 bool bufferResize(Buffer* buf, size_t size);
 
-int vgmReadSample(StreamHandle fin, Buffer* restrict buf);
+#define VGM_DATA_OFFSET       0x34        // Header field holding the relative start of command data
+#define VGM_LEGACY_DATA_START 0x40        // Command data start for files older than 1.50
+#define VGM_BLOCK_SIZE_MASK   0x7FFFFFFF  // Data block size bits, the high bit flags the second chip
+#define VGM_YM2610_ROM_MAX    0x1000000   // Largest sample ROM the YM2610 can address
+
+int vgmReadSample(StreamHandle fin, Buffer* restrict buf, BufferView* restrict outSample);
+// Step over a sample's data, returning where it starts in the stream so it can be read later
+int vgmSkipSample(StreamHandle fin, uint64_t* restrict outOffset, size_t* restrict outSize);
+// Validate the VGM header & skip to the start of command data, returns non-zero if not a VGM file
+int vgmReadHeader(StreamHandle file);
+// Decode commands up to the next ADPCM data block, returns 'A' or 'B' or 0 at the end of the data
+int vgmNextSample(StreamHandle file);
+// Heuristically search for the next plausible ADPCM data block in files without a usable header
 int vgmScanSample(StreamHandle file);
 
 #ifdef USE_ZLIB
@@ -0,0 +1,218 @@
+/* verify.c (c) 2025 a dinosaur (zlib) */
+
+#include "verify.h"
+#include "threadpool.h"
+#include "stream.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <assert.h>
+
+
+typedef struct VerifyTask
+{
+	const VerifyCodec* codec;
+	const uint8_t* data;  // Original stream of this block
+	size_t offset, size;  // Byte range of this block in the stream
+	const void* state;    // Decoder state at the start of the block
+	VerifyBlock* result;
+
+} VerifyTask;
+
+static void verifyBlock(void* user)
+{
+	const VerifyTask* task = (const VerifyTask*)user;
+	const VerifyCodec* codec = task->codec;
+	const int bytes = (int)task->size;
+
+	int16_t original[VERIFY_BLOCK_SIZE * 2], reencoded[VERIFY_BLOCK_SIZE * 2];
+	uint8_t stream[VERIFY_BLOCK_SIZE];
+	union { uint8_t bytes[256]; long long l; double d; void* p; } storage;  // Aligned for any decoder state
+	void* state = storage.bytes;
+	assert(codec->stateSize <= sizeof(storage.bytes));
+
+	// Decode the original & encode that again from the same starting state
+	memcpy(state, task->state, codec->stateSize);
+	codec->decode(state, task->data, original, bytes);
+	codec->encode(codec->user, task->state, original, stream, bytes * 2);
+
+	VerifyBlock* result = task->result;
+	(*result) = (VerifyBlock)
+	{
+		.diffNibbles  = 0,
+		.firstDiff    = SIZE_MAX,
+		.maxError     = 0,
+		.rmsError     = 0.0
+	};
+	for (int i = 0; i < bytes; ++i)
+	{
+		const unsigned diff = task->data[i] ^ stream[i];
+		if (fastPath(!diff))
+			continue;
+		if (result->firstDiff == SIZE_MAX)
+			result->firstDiff = (task->offset + (size_t)i) * 2 + !(diff & 0xF0);
+		result->diffNibbles += !!(diff & 0xF0) + !!(diff & 0x0F);
+	}
+	if (!result->diffNibbles)
+		return;
+
+	// Only blocks that changed can sound any different
+	memcpy(state, task->state, codec->stateSize);
+	codec->decode(state, stream, reencoded, bytes);
+	double squaredError = 0.0;
+	for (int i = 0; i < bytes * 2; ++i)
+	{
+		const long error = labs((long)original[i] - reencoded[i]);
+		result->maxError = MAX(result->maxError, error);
+		squaredError += (double)error * error;
+	}
+	result->rmsError = sqrt(squaredError / (double)(bytes * 2));
+}
+
+int verifyStream(VerifyResult* restrict out, const VerifyCodec* restrict codec, const uint8_t* restrict data,
+	size_t size, int numThreads)
+{
+	assert(out && codec && (data || !size));
+	(*out) = (VerifyResult)
+	{
+		.numBlocks   = (size + VERIFY_BLOCK_SIZE - 1) / VERIFY_BLOCK_SIZE,
+		.exactBlocks = 0,
+		.firstDiff   = SIZE_MAX,
+		.blocks      = NULL
+	};
+	if (!size)
+		return 0;
+
+	uint8_t* states = malloc(out->numBlocks * codec->stateSize);
+	VerifyTask* tasks = malloc(out->numBlocks * sizeof(VerifyTask));
+	out->blocks = malloc(out->numBlocks * sizeof(VerifyBlock));
+	if (!states || !tasks || !out->blocks)
+	{
+		free(tasks);
+		free(states);
+		verifyResultFree(out);
+		return ENOMEM;
+	}
+
+	// Each block depends on the decoder state left by the one before, which only decoding can tell us
+	int16_t scratch[VERIFY_BLOCK_SIZE * 2];
+	memcpy(states, codec->initState, codec->stateSize);
+	for (size_t i = 0; i < out->numBlocks; ++i)
+	{
+		const size_t offset = i * VERIFY_BLOCK_SIZE;
+		tasks[i] = (VerifyTask)
+		{
+			.codec  = codec,
+			.data   = &data[offset],
+			.offset = offset,
+			.size   = MIN(size - offset, VERIFY_BLOCK_SIZE),
+			.state  = &states[i * codec->stateSize],
+			.result = &out->blocks[i]
+		};
+		if (i + 1 < out->numBlocks)
+		{
+			memcpy(&states[(i + 1) * codec->stateSize], tasks[i].state, codec->stateSize);
+			codec->decode(&states[(i + 1) * codec->stateSize], tasks[i].data, scratch, (int)tasks[i].size);
+		}
+	}
+
+	// With the starting states known blocks are independent
+	ThreadPool* pool = NULL;
+	if (!numThreads)
+		numThreads = threadPoolDefaultThreads();
+	if (numThreads > 1 && out->numBlocks > 1 && threadPoolCreate(&pool, numThreads, numThreads * 2))
+		pool = NULL;
+	for (size_t i = 0; i < out->numBlocks; ++i)
+	{
+		if (pool)
+			threadPoolSubmit(pool, verifyBlock, &tasks[i]);
+		else
+			verifyBlock(&tasks[i]);
+	}
+	if (pool)
+		threadPoolDestroy(pool);
+
+	for (size_t i = 0; i < out->numBlocks; ++i)
+	{
+		if (!out->blocks[i].diffNibbles)
+			++out->exactBlocks;
+		else if (out->firstDiff == SIZE_MAX)
+			out->firstDiff = out->blocks[i].firstDiff;
+	}
+
+	free(tasks);
+	free(states);
+	return 0;
+}
+
+int verifyFile(VerifyResult* restrict out, const VerifyCodec* restrict codec, const char* restrict path,
+	int numThreads)
+{
+	assert(out && codec && path);
+	StreamHandle hnd;
+	int err = streamMapOpen(&hnd, path);
+	if (!err)
+	{
+		// The whole mapping can be borrowed at once
+		const void* data = NULL;
+		const size_t size = streamBorrow(hnd, &data, SIZE_MAX);
+		err = verifyStream(out, codec, (const uint8_t*)data, size, numThreads);
+		streamClose(hnd);
+		return err;
+	}
+	if ((err = streamFileOpenBuffered(&hnd, path, "rb", STREAM_BUFFER_DEFAULT_SIZE)))
+		return err;
+
+	// Otherwise read it all into memory, growing the buffer as needed
+	uint8_t* data = NULL;
+	size_t size = 0, capacity = 0, read;
+	do
+	{
+		if (size == capacity)
+		{
+			capacity = capacity ? capacity * 2 : 0x100000;
+			uint8_t* grown = realloc(data, capacity);
+			if (!grown)
+			{
+				free(data);
+				streamClose(hnd);
+				return ENOMEM;
+			}
+			data = grown;
+		}
+		size += (read = streamRead(hnd, &data[size], 1, capacity - size));
+	}
+	while (read);
+	err = streamError(hnd) ? EIO : verifyStream(out, codec, data, size, numThreads);
+	streamClose(hnd);
+	free(data);
+	return err;
+}
+
+void verifyReport(const VerifyResult* restrict result, FILE* restrict file)
+{
+	for (size_t i = 0; i < result->numBlocks; ++i)
+	{
+		const VerifyBlock* block = &result->blocks[i];
+		if (!block->diffNibbles)
+			continue;
+		fprintf(file, "Block %zu (0x%06zX): %zu nibbles differ, first at 0x%06zX%s, max error %ld, RMS error %.1f\n",
+			i, i * VERIFY_BLOCK_SIZE, block->diffNibbles, block->firstDiff / 2, (block->firstDiff & 1) ? " low" : " high",
+			block->maxError, block->rmsError);
+	}
+
+	if (result->firstDiff == SIZE_MAX)
+		fprintf(file, "All %zu blocks re-encoded bit exact\n", result->numBlocks);
+	else
+		fprintf(file, "%zu of %zu blocks re-encoded bit exact, first divergence at byte 0x%06zX (sample %zu)\n",
+			result->exactBlocks, result->numBlocks, result->firstDiff / 2, result->firstDiff);
+}
+
+void verifyResultFree(VerifyResult* restrict result)
+{
+	free(result->blocks);
+	result->blocks = NULL;
+	result->numBlocks = result->exactBlocks = 0;
+}
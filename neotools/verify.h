@@ -0,0 +1,56 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Bytes per block, a multiple of the chunks the encoders are fed so trellis frames line up
+#define VERIFY_BLOCK_SIZE 4096
+
+// Decode bytes of stream into 2 * bytes samples, advancing the decoder state
+typedef void (*VerifyDecodeFunc)(void* restrict state, const uint8_t* restrict in, int16_t* restrict out, int bytes);
+// Encode an even number of samples into samples / 2 bytes, starting from a decoder state
+typedef void (*VerifyEncodeFunc)(const void* restrict user, const void* restrict state,
+	const int16_t* restrict in, uint8_t* restrict out, int samples);
+
+typedef struct VerifyCodec
+{
+	size_t stateSize;
+	const void* initState;  // Decoder state at the start of a stream
+	VerifyDecodeFunc decode;
+	VerifyEncodeFunc encode;
+	const void* user;       // Passed to encode, for encoder settings
+
+} VerifyCodec;
+
+typedef struct VerifyBlock
+{
+	size_t diffNibbles;  // Nibbles that re-encoded differently
+	size_t firstDiff;    // Nibble offset of the first difference in the stream, SIZE_MAX if there were none
+	long maxError;       // Largest difference between decoding the original & the re-encoded block
+	double rmsError;
+
+} VerifyBlock;
+
+typedef struct VerifyResult
+{
+	size_t numBlocks, exactBlocks;
+	size_t firstDiff;    // Nibble offset of the first difference in the stream, SIZE_MAX if bit exact
+	VerifyBlock* blocks;
+
+} VerifyResult;
+
+// Decode the stream, re-encode it & compare against the original in VERIFY_BLOCK_SIZE blocks. The decoder
+//  state at each block is found serially, then blocks are re-encoded from it on numThreads workers
+//  (0 = hardware threads). Returns 0 or an errno value, free the result with verifyResultFree.
+int verifyStream(VerifyResult* restrict out, const VerifyCodec* restrict codec, const uint8_t* restrict data,
+	size_t size, int numThreads);
+// verifyStream over the contents of the file at path, mapped if possible
+int verifyFile(VerifyResult* restrict out, const VerifyCodec* restrict codec, const char* restrict path,
+	int numThreads);
+// Print per-block statistics of blocks that differ & a summary
+void verifyReport(const VerifyResult* restrict result, FILE* restrict file);
+void verifyResultFree(VerifyResult* restrict result);
+
+#endif//VERIFY_H
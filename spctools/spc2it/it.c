@@ -66,13 +66,14 @@ static s32 ITGetBRRPrediction(u8 filter, pcm_t p1, pcm_t p2)
 	return 0;
 }
 
+// Nybble is already sign extended to [-8, 7]
 static void ITDecodeSampleInternal(s8 s, u8 shift_am, u8 filter)
 {
 	s32 a;
 	if (shift_am <= 0x0c) // Valid shift count
-		a = ((s < 8 ? s : s - 16) << shift_am) >> 1;
+		a = (s << shift_am) >> 1;
 	else
-		a = s < 8 ? 1 << 11 : (-1) << 11; // Values "invalid" shift counts
+		a = s >= 0 ? 1 << 11 : (-1) << 11; // Values "invalid" shift counts
 
 	a += ITGetBRRPrediction(filter, p1, p2);
 
@@ -110,11 +111,16 @@ static s32 ITDecodeSample(u16 start, sndsamp **sp)
 		u8 range = src[brrptr++];
 		u8 filter = (range & 0x0c) >> 2;
 		u8 shift_amount = (range >> 4) & 0x0F;
+		// Expand the block's nybbles high first & sign extend them up front
+		s8 nybbles[16];
 		for (i = 0; i < 8; i++, brrptr++)
 		{
-			ITDecodeSampleInternal(src[brrptr] >> 4, shift_amount, filter); // Decode high nybble
-			s->buf[sampptr++] = 2 * p1;
-			ITDecodeSampleInternal(src[brrptr] & 0x0F, shift_amount, filter); // Decode low nybble
+			nybbles[i * 2] = (s8)(((src[brrptr] >> 4) ^ 8) - 8);
+			nybbles[i * 2 + 1] = (s8)(((src[brrptr] & 0x0F) ^ 8) - 8);
+		}
+		for (i = 0; i < 16; i++)
+		{
+			ITDecodeSampleInternal(nybbles[i], shift_amount, filter);
 			s->buf[sampptr++] = 2 * p1;
 		}
 	}